@@ -0,0 +1,128 @@
+/*
+Per-stage benchmark of the DiMorSC pipeline on a dense volume.
+Every stage is timed on its own with core/metrics.h and the report is
+written as <result_prefix>_metrics.json, same format as the other binaries.
+
+Execute command:
+	./bench_stages <volume.vol> <result_prefix> [persistence_threshold] [fill] [reorder] [threads]
+
+	persistence_threshold	default 32, see gen_tubes for the intensity range
+	fill					0: 12 triangles per cube (default), 1: 16
+	reorder					1: Morton order after load (included in load)
+	threads					for load, morse_function and filtration, default 1,
+							0 for all cores
+
+Stages:
+	read_volume		threshold the volume into the voxel grid
+	triangulate		GridComplex::triangulate, same as Triangulate on a .vol
+	write_sc		<result_prefix>.sc
+	load			buildComplexFromFile2_BIN, includes the first vertex sort
+	sort			vertex sort again on the loaded complex
+	morse_function	buildPsuedoMorseFunction
+	filtration		buildFiltrationWithLowerStar
+	persistence		PhatPersistence
+	cancel			cancelPersistencePairs
+	output			collectArcs and writing <result_prefix>_vert.txt/_edge.txt
+
+One run per process; bench/run.sh repeats and summarizes.
+*/
+
+#define DEBUG 0
+
+#define EPS_compare 1e-8
+
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+using namespace std;
+
+#include "Simplex.h"
+#include "persistence.h"
+#include "DiscreteVField.h"
+#include "Simplicial2Complex.h"
+#include "volume.h"
+#include "metrics.h"
+
+
+int main(int argc, char* argv[]){
+	if (argc < 3 || argc > 7){
+		cout << "Usage: ./bench_stages <volume.vol> <result_prefix> [persistence_threshold] [fill] [reorder] [threads]" << endl;
+		return 1;
+	}
+	string input = argv[1];
+	string prefix = argv[2];
+	double delta = argc >= 4? atof(argv[3]) : 32;
+	int nb = (argc >= 5 && atoi(argv[4]))? 16 : 12;
+	int nthreads = argc >= 7? atoi(argv[6]) : 1;
+	if (nthreads <= 0) nthreads = thread::hardware_concurrency();
+
+	Metrics M("bench_stages");
+	VolumeHeader h;
+	{
+		GridComplex G;
+		Stage read(M, "read_volume");
+		if (load_volume(input, h, G) != 0) return 1;
+		read.stop();
+		M.count("voxels", (long long)h.dim[0] * h.dim[1] * h.dim[2]);
+		M.count("voxels_above", G.vertices());
+
+		Stage tri(M, "triangulate");
+		G.triangulate(nb);
+		tri.stop();
+
+		Stage write(M, "write_sc");
+		G.write_sc(prefix + ".sc");
+	}
+
+	Simplicial2Complex<3> K;
+	K.setReorder(argc >= 6 && atoi(argv[5]));
+	Stage load(M, "load");
+	K.buildComplexFromFile2_BIN(prefix + ".sc", nthreads);
+	load.stop();
+	M.count("vertices", K.vsize());
+	M.count("edges", K.esize());
+	M.count("triangles", K.tsize());
+
+	// positions are reassigned as in the loader, so later stages see a
+	// consistent order even if the comparator reorders near-ties
+	Stage sort(M, "sort");
+	K.sortVertices();
+	int position = 0;
+	for(auto v = K.sBegin(); v != K.sEnd(); ++v) (*v)->setVposition(position++);
+	sort.stop();
+
+	Stage morse(M, "morse_function");
+	K.buildPsuedoMorseFunction(nthreads);
+	morse.stop();
+
+	Stage filt(M, "filtration");
+	K.buildFiltrationWithLowerStar(nthreads);
+	filt.stop();
+	M.count("filtration", K.fsize());
+
+	Stage pers(M, "persistence");
+	K.PhatPersistence();
+	pers.stop();
+	M.count("ms_pairs", K.mssize());
+	M.count("sm_pairs", K.smsize());
+
+	Stage cancel(M, "cancel");
+	K.cancelPersistencePairs(delta);
+	cancel.stop();
+	M.count("cancellations", K.cancelsize());
+
+	Stage out(M, "output");
+	Skeleton sk;
+	K.collectArcs(delta, sk);
+	write_skeleton(sk, prefix + "_vert.txt", prefix + "_edge.txt");
+	out.stop();
+	M.count("arc_vertices", sk.vcrit.size());
+	M.count("arc_edges", sk.ecrit.size());
+
+	if (M.write(prefix + "_metrics.json") != 0) return 1;
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+Synthetic neuron-like volume for benchmarks.
+Branching tubes grown from random seeds, plus gaussian background noise,
+written as a float32 .vol (see core/volume.h). The output only depends on
+the arguments.
+
+Execute command:
+	./gen_tubes <output.vol> <voxels> [seed] [noise] [threshold]
+
+	voxels		total voxel count, the volume is a cube of side cbrt(voxels),
+				e.g. 1e5 ... 1e9
+	seed		random seed, default 1
+	noise		standard deviation of the background noise, default 10
+	threshold	stored in the header, default 20; voxels <= threshold are
+				dropped by Triangulate / dimorsc_pipeline
+
+Tubes have intensity 200 on the axis and fall off as exp(-(d/r)^2).
+The number of trees grows with the cross-section of the volume, so the
+fraction of tube voxels stays roughly the same at every scale.
+Planes are generated and written in slabs, memory is O(side^2).
+*/
+
+#include<cstdio>
+#include<cstdlib>
+#include<cmath>
+#include<fstream>
+#include<iostream>
+#include<vector>
+#include<string>
+#include<random>
+#include<algorithm>
+
+using namespace std;
+
+
+const double PEAK = 200;
+const int SLAB = 16;		// planes generated at a time
+
+
+struct segment{
+	double a[3], b[3];
+	double r;
+	double lo[3], hi[3];	// bounding box of the tube, 3r margin
+};
+
+
+int side;
+vector<segment> tubes;
+
+
+void add_segment(const double *a, const double *b, double r){
+	segment s;
+	for(int d = 0; d < 3; ++d){
+		s.a[d] = a[d]; s.b[d] = b[d];
+		s.lo[d] = min(a[d], b[d]) - 3 * r;
+		s.hi[d] = max(a[d], b[d]) + 3 * r;
+	}
+	s.r = r;
+	tubes.push_back(s);
+}
+
+
+// random unit vector close to dir, spread in radians
+void perturb(mt19937 &rng, const double *dir, double spread, double *out){
+	normal_distribution<double> g(0, spread);
+	double len = 0;
+	for(int d = 0; d < 3; ++d){
+		out[d] = dir[d] + g(rng);
+		len += out[d] * out[d];
+	}
+	len = sqrt(len);
+	for(int d = 0; d < 3; ++d) out[d] /= len;
+}
+
+
+void grow(mt19937 &rng, const double *p, const double *dir, double r, int depth){
+	uniform_real_distribution<double> u(0, 1);
+	double L = side * (0.08 + 0.07 * u(rng));
+	double q[3];
+	for(int d = 0; d < 3; ++d)
+		q[d] = min(max(p[d] + dir[d] * L, 0.0), side - 1.0);
+	add_segment(p, q, r);
+	if (depth == 0) return;
+
+	int children = u(rng) < 0.35? 2 : 1;
+	for(int c = 0; c < children; ++c){
+		double next[3];
+		perturb(rng, dir, children == 1? 0.35 : 0.8, next);
+		grow(rng, q, next, max(1.0, r * 0.85), depth - 1);
+	}
+}
+
+
+// squared distance from p to the axis of s
+double seg_dist2(const segment &s, const double *p){
+	double ab[3], ap[3], l2 = 0, t = 0;
+	for(int d = 0; d < 3; ++d){
+		ab[d] = s.b[d] - s.a[d];
+		ap[d] = p[d] - s.a[d];
+		l2 += ab[d] * ab[d];
+		t += ab[d] * ap[d];
+	}
+	t = l2 > 0? min(max(t / l2, 0.0), 1.0) : 0;
+	double d2 = 0;
+	for(int d = 0; d < 3; ++d){
+		double x = ap[d] - t * ab[d];
+		d2 += x * x;
+	}
+	return d2;
+}
+
+
+// max of tube intensities over planes [z0, z0 + nz)
+void splat(vector<float> &slab, int z0, int nz){
+	size_t plane = (size_t)side * side;
+	for(auto &s : tubes){
+		if (s.hi[2] < z0 || s.lo[2] >= z0 + nz) continue;
+		int lo[3], hi[3];
+		for(int d = 0; d < 3; ++d){
+			lo[d] = max(0, (int)ceil(s.lo[d]));
+			hi[d] = min(side - 1, (int)floor(s.hi[d]));
+		}
+		lo[2] = max(lo[2], z0);
+		hi[2] = min(hi[2], z0 + nz - 1);
+		double cut = 9 * s.r * s.r;
+		for(int k = lo[2]; k <= hi[2]; ++k)
+			for(int j = lo[1]; j <= hi[1]; ++j)
+				for(int i = lo[0]; i <= hi[0]; ++i){
+					double p[3] = {(double)i, (double)j, (double)k};
+					double d2 = seg_dist2(s, p);
+					if (d2 > cut) continue;
+					float f = PEAK * exp(-d2 / (s.r * s.r));
+					float &v = slab[(k - z0) * plane + (size_t)j * side + i];
+					if (f > v) v = f;
+				}
+	}
+}
+
+
+int main(int argc, char* argv[]){
+	if (argc < 3 || argc > 6){
+		cout << "Usage: ./gen_tubes <output.vol> <voxels> [seed] [noise] [threshold]" << endl;
+		return 1;
+	}
+	string outname = argv[1];
+	double voxels = atof(argv[2]);
+	unsigned seed = argc >= 4? atoi(argv[3]) : 1;
+	double noise = argc >= 5? atof(argv[4]) : 10;
+	double thd = argc >= 6? atof(argv[5]) : 20;
+	side = (int)round(cbrt(voxels));
+	if (side < 8){
+		cout << "Volume too small: side " << side << endl;
+		return 1;
+	}
+
+	// trees start on random points of the volume, heading anywhere
+	mt19937 rng(seed);
+	uniform_real_distribution<double> u(0, 1);
+	int trees = max(1, side * side / 2500);
+	for(int t = 0; t < trees; ++t){
+		double p[3], dir[3], up[3] = {0, 0, 1};
+		for(int d = 0; d < 3; ++d) p[d] = u(rng) * (side - 1);
+		perturb(rng, up, 10.0, dir);
+		grow(rng, p, dir, 2 + 2 * u(rng), 6);
+	}
+	printf("Volume %d^3, %d trees, %d tube segments\n", side, trees, (int)tubes.size());
+
+	ofstream ofs(outname.c_str(), ios::binary);
+	if (!ofs.is_open()){
+		printf("Cannot write %s\n", outname.c_str());
+		return 1;
+	}
+	int dim[3] = {side, side, side}, dtype = 4, offset[3] = {0, 0, 0};
+	double spacing[3] = {1, 1, 1};
+	ofs.write((char*) dim, sizeof(int) * 3);
+	ofs.write((char*) &dtype, sizeof(int));
+	ofs.write((char*) &thd, sizeof(double));
+	ofs.write((char*) spacing, sizeof(double) * 3);
+	ofs.write((char*) offset, sizeof(int) * 3);
+
+	// noise is drawn per plane, so it does not depend on the slab size
+	size_t plane = (size_t)side * side;
+	long long above = 0;
+	vector<float> slab(plane * SLAB);
+	for(int z0 = 0; z0 < side; z0 += SLAB){
+		int nz = min(SLAB, side - z0);
+		fill(slab.begin(), slab.end(), 0.0f);
+		splat(slab, z0, nz);
+		for(int k = 0; k < nz; ++k){
+			mt19937 prng(seed * 1000003u + z0 + k);
+			normal_distribution<float> g(0, noise > 0? noise : 1);
+			float *v = &slab[k * plane];
+			for(size_t n = 0; n < plane; ++n){
+				if (noise > 0) v[n] = max(0.0f, v[n] + g(prng));
+				if (v[n] > thd) above++;
+			}
+		}
+		ofs.write((char*) slab.data(), sizeof(float) * plane * nz);
+		cout << '\r' << min(z0 + SLAB, side) << "/" << side;
+		cout.flush();
+	}
+	ofs.close();
+	printf("\n%lld of %lld voxels above threshold %g\n", above, (long long)plane * side, thd);
+	return 0;
+}
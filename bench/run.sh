@@ -0,0 +1,82 @@
+#!/bin/sh
+# DiMorSC benchmark suite.
+#
+#   bench/run.sh [scale ...]		e.g. bench/run.sh 1e5 1e6 1e7
+#
+# For every scale (voxel count, default 1e5 1e6) a tube volume is generated
+# with gen_tubes, then bench_stages (per-stage timings) and dimorsc_pipeline
+# (triangulation -> DiMorSC -> to_tree, end to end) run REPS times each.
+# All reports are summarized by bench/summarize.py into $OUT.
+#
+# Environment:
+#	REPS	repetitions per benchmark, default 3
+#	DELTA	persistence threshold, default 32
+#	SEED	generator seed, default 1
+#	WORK	scratch folder, default bench/out
+#	OUT		result file, default $WORK/results.json
+#	BIN		folder of the binaries, default bin
+#
+# Volumes are kept in $WORK and reused by later runs with the same seed.
+
+REPS=${REPS:-3}
+DELTA=${DELTA:-32}
+SEED=${SEED:-1}
+WORK=${WORK:-bench/out}
+OUT=${OUT:-$WORK/results.json}
+BIN=${BIN:-bin}
+SCALES=${*:-1e5 1e6}
+
+mkdir -p "$WORK/logs"
+for b in gen_tubes bench_stages dimorsc_pipeline; do
+	if [ ! -x "$BIN/$b" ]; then
+		echo "$BIN/$b not found, run make bench_bin dimorsc_pipeline first"
+		exit 1
+	fi
+done
+
+cat > "$WORK/pipeline.json" <<EOF
+{
+"type":"DiMorSC",
+"data":[
+    {"action":"triangulation"},
+    {"action":"DiMorSC", "threshold":$DELTA},
+    {"action":"to_tree", "root":"0 0 0", "component":10}
+]
+}
+EOF
+
+# metrics of an earlier run in $WORK must never stand in for a failed one
+fail(){
+	echo "[$1] $2 failed, see $WORK/logs/$2_$1_r$r.txt"
+	exit 1
+}
+
+REPORTS=""
+for s in $SCALES; do
+	vol="$WORK/tubes_${s}_s$SEED.vol"
+	if [ ! -f "$vol" ]; then
+		echo "Generating $vol"
+		"$BIN/gen_tubes" "$vol" "$s" "$SEED" > "$WORK/logs/gen_$s.txt" || exit 1
+	fi
+	r=1
+	while [ $r -le "$REPS" ]; do
+		echo "[$s] run $r/$REPS"
+		p="$WORK/stages_${s}_r$r"
+		m="${p}_metrics.json"
+		rm -f "$m"
+		"$BIN/bench_stages" "$vol" "$p" "$DELTA" > "$WORK/logs/stages_${s}_r$r.txt" || fail "$s" stages
+		[ -f "$m" ] || fail "$s" stages
+		REPORTS="$REPORTS $s/stages=$m"
+
+		w="$WORK/e2e_${s}_r$r"
+		m="$w/tubes_${s}_s${SEED}_metrics.json"
+		mkdir -p "$w"
+		rm -f "$m"
+		"$BIN/dimorsc_pipeline" "$vol" "$WORK/pipeline.json" "$w" > "$WORK/logs/e2e_${s}_r$r.txt" || fail "$s" e2e
+		[ -f "$m" ] || fail "$s" e2e
+		REPORTS="$REPORTS $s/end_to_end=$m"
+		r=$((r + 1))
+	done
+done
+
+python3 bench/summarize.py "$OUT" $REPORTS
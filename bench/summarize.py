@@ -0,0 +1,98 @@
+'''
+Benchmark summary
+
+Collects <prefix>_metrics.json reports (core/metrics.h) of repeated runs
+into one comparable result file.
+
+Usage:
+    python3 bench/summarize.py <result.json> <label>=<metrics.json> ...
+
+Reports with the same label are repetitions of one benchmark, e.g.
+"1e6/stages" or "1e6/end_to_end". For every label the result has the
+min and median wall time of the run and of each stage, the median CPU
+time, the largest peak RSS and the counters; "stable" is false if the
+counters differ between repetitions.
+'''
+
+
+import json
+import os
+import platform
+import sys
+import time
+from collections import OrderedDict
+
+
+def median(values):
+    values = sorted(values)
+    n = len(values)
+    if n % 2:
+        return values[n // 2]
+    return round(0.5 * (values[n // 2 - 1] + values[n // 2]), 6)
+
+
+def summarize(label, reports):
+    '''
+    Summary of the reports of one label, stages kept in run order
+    '''
+    scale, _, bench = label.partition('/')
+    stages = OrderedDict()
+    for r in reports:
+        for s in r['stages']:
+            stages.setdefault(s['name'], []).append(s)
+    result = OrderedDict()
+    result['scale'] = scale
+    result['benchmark'] = bench
+    result['binary'] = reports[0]['binary']
+    result['reps'] = len(reports)
+    result['wall'] = OrderedDict([
+        ('min', min(r['wall'] for r in reports)),
+        ('median', median([r['wall'] for r in reports]))])
+    result['cpu'] = median([r['cpu'] for r in reports])
+    result['peak_rss_kb'] = max(r['peak_rss_kb'] for r in reports)
+    result['stages'] = []
+    for name, runs in stages.items():
+        result['stages'].append(OrderedDict([
+            ('name', name),
+            ('min', min(s['wall'] for s in runs)),
+            ('median', median([s['wall'] for s in runs])),
+            ('cpu', median([s['cpu'] for s in runs])),
+            ('peak_rss_kb', max(s['peak_rss_kb'] for s in runs))]))
+    result['counters'] = reports[0]['counters']
+    result['stable'] = all(r['counters'] == reports[0]['counters'] for r in reports)
+    return result
+
+
+def main(argv):
+    if len(argv) < 3:
+        print('Usage: python3 bench/summarize.py <result.json> <label>=<metrics.json> ...')
+        return 0
+    groups = OrderedDict()
+    for arg in argv[2:]:
+        label, _, path = arg.partition('=')
+        if not os.path.exists(path):
+            print('Missing report ' + path)
+            continue
+        with open(path) as f:
+            groups.setdefault(label, []).append(json.load(f, object_pairs_hook=OrderedDict))
+
+    out = OrderedDict()
+    out['suite'] = 'DiMorSC bench'
+    out['date'] = time.strftime('%Y-%m-%dT%H:%M:%S')
+    out['host'] = platform.node()
+    out['cpus'] = os.cpu_count()
+    out['results'] = [summarize(label, reports) for label, reports in groups.items()]
+    with open(argv[1], 'w') as f:
+        json.dump(out, f, indent=1)
+        f.write('\n')
+
+    for r in out['results']:
+        print('{:>6} {:<12} wall {:8.3f}s (median of {}), peak {:8d} KB{}'.format(
+            r['scale'], r['benchmark'], r['wall']['median'], r['reps'], r['peak_rss_kb'],
+            '' if r['stable'] else ', counters differ between runs'))
+    print('Results written to ' + argv[1])
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -12,17 +12,41 @@ Compile:
 
 	
 Execute command:
-	./DiMorSC <input_file> <output_prefix> <persistence_threshold> <DIM> [saved_persis_pair]
+	./DiMorSC <input_file> <output_prefix> <persistence_threshold> <DIM> [saved_persis_pair] [et_threshold] [roi_file] [threads] [reorder] [snapshot]
+	./DiMorSC --serve <input_file | prefix.snap> <DIM> [socket_path]
 
 	
 Parameters:
 	// argv[1] - BIN file, format specified below.
 	// argv[2] - Prefix of output files
 	// argv[3] - Persistence threshold for simplification
-	// argv[4] - Dimension of points (2 or 3)
+	// argv[4] - Dimension of points (2, 3 or 4)
 	// argv[5] - If specified, the program will load previously 
-				 computed persistence pairing.
-	// argv[6] - reserved.
+				 computed persistence pairing: either <prefix>_presave.bin
+				 (argv[1] is re-read), or <prefix>.snap, a snapshot of the
+				 whole complex after persistence, which skips reading
+				 argv[1] and starts cancelling right away.
+				 "-" computes everything from argv[1].
+	// argv[6] - Persistence threshold for e-t pairs, "-" for argv[3].
+	// argv[7] - If specified, a text file with a region of interest
+				 ("box x0 y0 z0 x1 y1 z1" or "seeds v0 v1 ..."); only arcs
+				 passing through it are written. See roi.h. "-" for none.
+	// argv[8] - Threads, default 1, 0 for all cores. Used by building the
+				 complex from argv[1], the pseudo-Morse function and the
+				 lower-star filtration (per spatial slab). Persistence,
+				 cancellation and output run on one thread, which bounds
+				 the overall speedup. The output does not depend on the
+				 thread count.
+	// argv[9] - If 1, vertices, edges and triangles are renumbered along a
+				 Morton curve of the coordinates after reading argv[1], for
+				 memory locality in the later stages. Output is unchanged.
+	// argv[10] - If 1, <prefix>.snap is written next to <prefix>_presave.bin
+				 when persistence is computed. It holds the whole complex
+				 (a few times the size of argv[1]), so it is off by default.
+
+	--serve keeps the complex in memory after persistence and answers
+	threshold requests (with an optional box) over stdin, or over a Unix
+	socket if socket_path is given. See serve.h for the protocol.
 
 	
 Input specification:
@@ -38,7 +62,8 @@ Input specification:
 	2: contains geographic information of vertices in blocks.
 	   Each of the <num_vertices> blocks has the following information:
 	   [v.x1 v.x2 ... v.xn v.f], xn bounded by DIM.
-	   Currently, supports DIM = 2 and 3. For higher dimensions, please adjust the constant MAX_DIM in simplicial2complex.h
+	   The complex is templated on DIM; dispatch() instantiates DIM = 2, 3 and 4.
+	   For other dimensions, add a case to dispatch() below.
 	   v.x_i and v.f are all of type double
 	3: contains a single int32 specifying the total number of edges
 	4: specifies how edges are connected using index pairs.
@@ -49,6 +74,7 @@ Input specification:
 	   A tuple [v1 v2 v3] specifies an triangles formed by connecting vertices of index v1, v2 and v3.
 
 The output are two ascii files <output_prefix>_vert.txt, [output_prefix]_edge.txt.
+Stage times, peak memory and complex sizes are written to <output_prefix>_metrics.json.
 See example for more input and output details.
 
 Additional Assumption: 
@@ -59,27 +85,49 @@ Additional Assumption:
 
 #define DEBUG 0
 
-int DIM;			// Dimension of data - 3 for 3D, 2 for 2D
-
-// For higher dimension, change MAX_DIM
-#define MAX_DIM 3			// - Will be used in Simplex.h
 #define EPS_compare 1e-8	// - used in comparison functions
 
-#include <ctime>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <thread>
 using namespace std;
 
 #include "Simplex.h"
 #include "persistence.h"
 #include "DiscreteVField.h"
 #include "Simplicial2Complex.h"
+#include "metrics.h"
+#include "serve.h"
 
 
-int main(int argc, char* argv[]){
+//  Load once, then answer requests until quit (see serve.h)
+template<int D>
+int run_server(int argc, char* argv[]){
+	string input = argv[2];
+	FILE *reply = argc >= 5? NULL : take_stdout();
+	Simplicial2Complex<D> K;
+	if (input.size() > 5 && input.compare(input.size() - 5, 5, ".snap") == 0){
+		cout << "Restoring snapshot...\n";
+		if (K.Load_Snapshot(input) != 0) return 0;
+	}else{
+		cout << "Reading in simplicial complex...\n";
+		K.buildComplexFromFile2_BIN(input);
+		cout << "Building pseudo-Morse function...\n";
+		K.buildPsuedoMorseFunction();
+		cout << "Building filtration...\n";
+		K.buildFiltrationWithLowerStar();
+		cout << "Computing persistence pairs...\n";
+		K.PhatPersistence();
+	}
+	return serve(K, reply, argc >= 5? argv[4] : "");
+}
+
+
+template<int D>
+int run(int argc, char* argv[]){
 	// Output filenames
 	string output_file[2];
 	// pre-save filename
@@ -92,33 +140,34 @@ int main(int argc, char* argv[]){
 	double ve_delta = 0;
 	
 	
-	//  Resolving parameters
-    if (argc < 5){
-    	// must provide 4 parameters.
-    	// argv[1] - inut_file
-    	// argv[2] - output_file
-    	// argv[3] - persistence_threshold
-    	// argv[4] - dimension
-    	// argv[5] - use_previous - optional
-    	// argv[6] - triangle threshold - under experiment
-		cout << "Usage: ./DiMorSC <input_file> <output_file> <persistence_threshold> <dimension> [use_previous]"
-		<<endl;
-		return 0;
-    }else{
-		output_file[0] = string(argv[2]) + "_vert.txt";
-		output_file[1] = string(argv[2]) + "_edge.txt";
-		ve_delta = atof(argv[3]);
-		DIM = atoi(argv[4]);
-	}
-    if (argc >= 6){
+	//  Resolving parameters, argc >= 5 (checked in main)
+	output_file[0] = string(argv[2]) + "_vert.txt";
+	output_file[1] = string(argv[2]) + "_edge.txt";
+	ve_delta = atof(argv[3]);
+    if (argc >= 6 && string(argv[5]) != "-"){
 		pre_save = string(argv[5]);
 		use_pre_save = true;
     }
-    if (argc >= 7){
+    if (argc >= 7 && string(argv[6]) != "-"){
     	et_delta = atof(argv[6]);
     }else{
     	et_delta = ve_delta;
     }
+	Roi roi;
+	if (argc >= 8 && string(argv[7]) != "-"){
+		ifstream roi_file(argv[7]);
+		if (!roi_file.is_open() || parse_roi(roi_file, roi, D) != 0 || roi.empty()){
+			cout << "Cannot read a region of interest from " << argv[7] << endl;
+			return 0;
+		}
+	}
+	int nthreads = 1;
+	if (argc >= 9){
+		nthreads = atoi(argv[8]);
+		if (nthreads <= 0) nthreads = thread::hardware_concurrency();
+	}
+	bool reorder = argc >= 10 && atoi(argv[9]) != 0;
+	bool snapshot = argc >= 11 && atoi(argv[10]) != 0;
 	
 	cout << argc-1 << " parameters detected"<< endl;
 	
@@ -127,97 +176,151 @@ int main(int argc, char* argv[]){
 	if (DEBUG){
 		cout << "debug mode\n";
 		// memory usage info.
-		cout << sizeof(Simplex) << " " << sizeof(Vertex) << " " << sizeof(Edge) << " "
+		cout << sizeof(Simplex) << " " << sizeof(VertexD<D>) << " " << sizeof(Edge) << " "
 			 << sizeof(Triangle) << " " << sizeof(Triangle*)<< endl;
 	}
 	
 	
 	//  Main pipeline
-	Simplicial2Complex K;
-	clock_t startTime;
-    clock_t testTime;
-    double time_passed = 0;
+	Simplicial2Complex<D> K;
+	K.setReorder(reorder);
+	Metrics M("DiMorSC");
 	if (!use_pre_save){
 		
 		//  Loading input file
 		cout << "Reading in simplicial complex...\n";
-		startTime = clock();
-		K.buildComplexFromFile2_BIN(argv[1]);
-		testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-		cout << "Done in " << time_passed << " \n";
+		Stage read(M, "read");
+		K.buildComplexFromFile2_BIN(argv[1], nthreads);
+		cout << "Done in " << read.stop() << " \n";
 		cout.flush();
+		M.count("vertices", K.vsize());
+		M.count("edges", K.esize());
+		M.count("triangles", K.tsize());
 		// cin.get(); // has test
 	
 
 		// Build psudo morse function
 		cout << "Building pseudo-Morse function...\n";
-		startTime = clock();
-		K.buildPsuedoMorseFunction();
-		testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-		cout << "Done in " << time_passed << " \n";
+		Stage morse(M, "morse_function");
+		K.buildPsuedoMorseFunction(nthreads);
+		cout << "Done in " << morse.stop() << " \n";
 		cout.flush();
 		// cin.get(); 
 
 		
 		//  Build filtration
 		cout << "Building filtration...\n";
-		startTime = clock();
-		K.buildFiltrationWithLowerStar();
-		testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-                cout << "Done in " << time_passed << " \n";
+		Stage filt(M, "filtration");
+		K.buildFiltrationWithLowerStar(nthreads);
+		cout << "Done in " << filt.stop() << " \n";
 		cout.flush();
+		M.count("filtration", K.fsize());
 		// cin.get(); // has test
 
 		
 		//  Computing persistence pairs using PHAT
 		cout << "Computing persistence pairs...\n";
-		startTime = clock();
+		Stage pers(M, "persistence");
 		K.PhatPersistence();
-		testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-                cout << "Done in " << time_passed << " \n";
+		cout << "Done in " << pers.stop() << " \n";
 		cout.flush();
 		
 		
 		//  Writing persistence info.
 		cout << "Writing pre_saved_data...\n";
-		startTime = clock();
+		Stage save(M, "write_presave");
 		K.write_presave(argv[2]);
-		testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-                cout << "Done in " << time_passed << " \n";
+		if (snapshot) K.write_snapshot(string(argv[2]) + ".snap");
+		cout << "Done in " << save.stop() << " \n";
 		cout.flush();
+	}else if (pre_save.size() > 5 && pre_save.compare(pre_save.size() - 5, 5, ".snap") == 0){
+		cout << "Restoring snapshot...\n";
+		Stage load(M, "load_snapshot");
+		if (K.Load_Snapshot(pre_save) != 0) return 0;
+		cout << "Done in " << load.stop() << " \n";
+		cout.flush();
+		M.count("vertices", K.vsize());
+		M.count("edges", K.esize());
+		M.count("triangles", K.tsize());
 	}else{
 		cout << "Reading in pre_saved_data...\n";
-		startTime = clock();
+		Stage load(M, "load_presave");
 		K.Load_Presaved(argv[1], pre_save);
-		testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-                cout << "Done in " << time_passed << " \n";
+		cout << "Done in " << load.stop() << " \n";
 		cout.flush();
+		M.count("vertices", K.vsize());
+		M.count("edges", K.esize());
+		M.count("triangles", K.tsize());
 		// cin.get();
 		
 		// Build psudo morse function
 		cout << "Building pseudo-Morse function...\n";
-                startTime = clock();
-		K.buildPsuedoMorseFunction();
-		testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-                cout << "Done in " << time_passed << " \n";
+		Stage morse(M, "morse_function");
+		K.buildPsuedoMorseFunction(nthreads);
+		cout << "Done in " << morse.stop() << " \n";
 		cout.flush();
 	}
+	M.count("ms_pairs", K.mssize());
+	M.count("sm_pairs", K.smsize());
 
 	
 	//  Cancelling persistence pairs
 	cout << "Cancelling persistence pairs with delta " << ve_delta << "\n";
-	startTime = clock();
+	Stage cancel(M, "cancel");
 	// Cancellation does not use function values on simplicies
 	K.cancelPersistencePairs(ve_delta);
-	testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-        cout << "Done in " << time_passed << " \n";
+	cout << "Done in " << cancel.stop() << " \n";
 	cout.flush();
+	M.count("cancellations", K.cancelsize());
+	M.count("critical", K.csize());
 	
 	
 	//  Writing output
-	startTime = clock();
-	K.outputArcs(output_file[0], output_file[1], et_delta);
-	testTime = clock(); time_passed = (startTime - testTime) / (double) CLOCKS_PER_SEC;
-        cout << "Results written in " << time_passed << " \n";
+	Stage arcs(M, "output_arcs");
+	Skeleton sk;
+	K.collectArcs(et_delta, sk, &roi);
+	write_skeleton(sk, output_file[0], output_file[1]);
+	cout << "Results written in " << arcs.stop() << " \n";
+	M.count("arc_vertices", sk.vcrit.size());
+	M.count("arc_edges", sk.ecrit.size());
+
+	M.write(string(argv[2]) + "_metrics.json");
 	return 0;
 }
+
+
+//  Picks the instantiation for the dimension given on the command line.
+//  To support another dimension, add a case here.
+int dispatch(int dim, bool server, int argc, char* argv[]){
+	switch (dim){
+		case 2: return server? run_server<2>(argc, argv) : run<2>(argc, argv);
+		case 3: return server? run_server<3>(argc, argv) : run<3>(argc, argv);
+		case 4: return server? run_server<4>(argc, argv) : run<4>(argc, argv);
+	}
+	cout << "Dimension " << dim << " is not supported (2, 3 or 4)" << endl;
+	return 0;
+}
+
+
+int main(int argc, char* argv[]){
+	if (argc >= 2 && string(argv[1]) == "--serve"){
+		if (argc < 4){
+			cout << "Usage: ./DiMorSC --serve <input_file | prefix.snap> <dimension> [socket_path]" << endl;
+			return 0;
+		}
+		return dispatch(atoi(argv[3]), true, argc, argv);
+	}
+	if (argc < 5){
+		// must provide 4 parameters.
+		// argv[1] - inut_file
+		// argv[2] - output_file
+		// argv[3] - persistence_threshold
+		// argv[4] - dimension
+		// argv[5] - use_previous - optional
+		// argv[6] - triangle threshold - under experiment
+		cout << "Usage: ./DiMorSC <input_file> <output_file> <persistence_threshold> <dimension> [use_previous | -] [et_threshold | -] [roi_file | -] [threads] [reorder] [snapshot]"
+		<<endl;
+		return 0;
+	}
+	return dispatch(atoi(argv[4]), false, argc, argv);
+}
@@ -4,6 +4,48 @@ Use vertex/edge/triangle lists that explicitly stores pointers of neighbours
 */
 
 #include<cmath>
+#include<limits>
+
+
+//  Storage types of function values and coordinates, chosen at build time.
+//  -DFLOAT_VALUES stores function values, persistence and pairs as float.
+//  -DGRID_COORDS=16 or 32 stores coordinates as int16/int32 grid positions;
+//  inputs must then have integer coordinates in range.
+//  Files (.sc, presave, snapshot) always hold doubles.
+#ifdef FLOAT_VALUES
+typedef float value_t;
+#else
+typedef double value_t;
+#endif
+
+//  Tolerance for comparing values of magnitude up to |a| and |b|. Doubles
+//  use the fixed EPS_compare. Floats keep about 7 digits, so there it is a
+//  few float epsilons relative to the larger magnitude.
+inline value_t value_eps(double a, double b = 0){
+#ifdef FLOAT_VALUES
+	return 4 * numeric_limits<value_t>::epsilon() * fmax(1.0, fmax(fabs(a), fabs(b)));
+#else
+	return EPS_compare;
+#endif
+}
+
+#if GRID_COORDS == 16
+typedef short coord_t;
+#elif GRID_COORDS == 32
+typedef int coord_t;
+#else
+typedef double coord_t;
+#endif
+
+//  false if x cannot be stored exactly as a coordinate
+bool coord_fits(double x){
+#if GRID_COORDS
+	return x >= numeric_limits<coord_t>::min() && x <= numeric_limits<coord_t>::max()
+		   && x == (coord_t)x;
+#else
+	return true;
+#endif
+}
 
 
 class Simplex;
@@ -19,14 +61,14 @@ public:
 	// It contains only local info: A Simplex knows only its vertices
 	// Interconnection between Simplex is in Simplicial Complex
 	int dim;
-	double funcValue;
+	value_t funcValue;
 	unsigned int filtrationPosition;
 };
 
 
+//  Position info only; coordinates are in VertexD<D> below, so code that
+//  does not need them does not depend on the dimension.
 class Vertex:public Simplex{
-	// will deprecate coords, since it is uncessary to have them.
-	double coords[MAX_DIM];
 	int vPosition;
 	int oriPosition;
 	// vector<Edge*> incidenceList;
@@ -34,9 +76,6 @@ class Vertex:public Simplex{
 	
 	
 public:
-	Vertex(double *coords, double funcValue);
-	
-	double* getCoords();
 	double getFuncValue();
 	void setFuncValue(double v){
 		funcValue = v;
@@ -49,16 +88,33 @@ public:
 	void setoriposition(int p){
 		oriPosition = p;
 	}
+	// deprecated functions
+};
+
+
+//  Vertex with D coordinates, D fixed at compile time
+template<int D>
+class VertexD:public Vertex{
+	coord_t coords[D];
+
+public:
+	VertexD(const double *coords, double funcValue){
+		for (int i = 0; i < D; i++) {
+			this->coords[i] = coords[i];
+		}
+		this->funcValue = funcValue;
+		this->dim = 0;
+	}
+	
+	double getcoord(int i) const {
+		return coords[i];
+	}
 	void output(ofstream& ofs){
-		for(int i = 0; i< DIM; i++){
+		for(int i = 0; i< D; i++){
 			ofs << coords[i] <<" ";
 		}
-	    ofs << funcValue << " " << vPosition << "/" << oriPosition << " " << dim <<"\n";
+	    ofs << funcValue << " " << getVPosition() << "/" << getoriPosition() << " " << dim <<"\n";
 	}
-    double getcoord(int i){
-        return coords[i];
-    }
-	// deprecated functions
 };
 
 
@@ -67,12 +123,12 @@ class Edge:public Simplex{
 	int vertices[2];		// vertices should be sorted
 	int ePosition;
 	Vertex* vp[2];
-	double eval = 0;		// used to mark supporting saddle
+	value_t eval = 0;		// used to mark supporting saddle
 	// moved to Class Simplicialcomplex
 	// vector<Triangle*> incidenceList;
 
 public:
-	double persistence;
+	value_t persistence = 0;		// stays 0 for unpaired (essential) edges
 	int critical_type;
 	Edge(int v1, int v2){
 		vertices[0] = v1; vertices[1] = v2;
@@ -97,12 +153,13 @@ public:
 	void setEval(double v) {eval = v;}
 	
 	//  Sort edge by gradient instead of vertex density
+	template<int D>
     double Grad(){
-        Vertex* v0, *v1;
-        v0 = vp[0]; v1 = vp[1];
+        VertexD<D>* v0, *v1;
+        v0 = (VertexD<D>*)vp[0]; v1 = (VertexD<D>*)vp[1];
         double fdiff = fabs(v0->funcValue - v1->funcValue);
         double len = 0;
-        for(int i = 0; i<DIM; ++i){
+        for(int i = 0; i<D; ++i){
             len += (v0->getcoord(i) - v1->getcoord(i)) * (v0->getcoord(i) - v1->getcoord(i));
         }
         len = sqrt(len);
@@ -127,6 +184,13 @@ public:
 		}
 		dim = 2;
 	}
+	Triangle(const int *v, const int *e){
+		for(int i = 0; i < 3; i++){
+			edges[i] = e[i];
+			vertices[i] = v[i];
+		}
+		dim = 2;
+	}
 	
 	int* getEdges();
 	int* getVertices();
@@ -155,18 +219,6 @@ public:
 	// Deprecated
 };
 
-Vertex::Vertex(double *coords, double funcValue){
-	for (int i = 0; i < DIM; i++) {
-		this->coords[i] = coords[i];
-	}
-	this->funcValue = funcValue;
-	this->dim = 0;
-}
-
-double* Vertex::getCoords(){
-	return coords;
-}
-
 double Vertex::getFuncValue(){
 	return funcValue;
 }
@@ -12,15 +12,128 @@ Organizes simplicial complex/dicrete gradient vector field/persistence pairs
 #include <fstream>
 #include <iomanip>
 
+#include "binfile.h"
+#include "roi.h"
+#include "parallel.h"
+#include "sfc.h"
+
 using namespace std;
 
 
-class Simplicial2Complex;
+//  .sc v1 stores counts and indices as int32.
+//  .sc v2 (Triangulate streaming mode) starts with int32 -2 and stores
+//  counts and indices as int64. Both are read into int indices here.
+long long sc_read_int(ifstream &file, bool v2){
+	if (v2){
+		long long n;
+		file.read((char*) &n, sizeof(long long));
+		return n;
+	}
+	int n;
+	file.read((char*) &n, sizeof(int));
+	return n;
+}
+
+//  reads data.size() indices in one block
+void sc_read_ints(ifstream &file, bool v2, vector<int> &data){
+	if (!v2){
+		file.read((char*) data.data(), sizeof(int) * data.size());
+		return;
+	}
+	vector<long long> wide(data.size());
+	file.read((char*) wide.data(), sizeof(long long) * wide.size());
+	for (size_t i = 0; i < data.size(); i++) data[i] = wide[i];
+}
+
+int sc_read_count(ifstream &file, bool &v2, bool first){
+	if (first){
+		int n;
+		file.read((char*) &n, sizeof(int));
+		v2 = (n == -2);
+		if (!v2) return n;
+	}
+	long long n = sc_read_int(file, v2);
+	if (n > 2147483647LL / 3){
+		cout << "Too many simplices (" << n << "), please use split and merge\n";
+		exit(1);
+	}
+	return n;
+}
+
+//  With GRID_COORDS the coordinates are stored as integers: exits if a
+//  coordinate of vert (dim coordinates + function value per vertex) does not fit
+void sc_check_coords(const vector<double> &vert, int dim){
+#if GRID_COORDS
+	for (size_t i = 0; i < vert.size(); i++){
+		if (i % (dim + 1) != (size_t)dim && !coord_fits(vert[i])){
+			cout << "Coordinate " << vert[i] << " is not a " << GRID_COORDS
+				 << "-bit grid position, please build without GRID_COORDS\n";
+			exit(1);
+		}
+	}
+#endif
+}
+
+
+//  1-stable manifold, same content as the _vert.txt/_edge.txt output
+struct Skeleton{
+	int dim;				// coordinates per vertex
+	vector<double> vert;	// dim coordinates + function value per vertex
+	vector<int> vcrit;		// 0 if critical, -1 otherwise
+	vector<int> edge;		// 2 vertex indices per edge, starting from 1
+	vector<int> ecrit;		// 1 if critical, -1 otherwise
+	vector<double> eval;	// persistence of the supporting saddle
+};
+
+
+//  -1 if the files cannot be created
+int write_skeleton(const Skeleton &sk, string vertexFile, string edgeFile){
+	ofstream vFile(vertexFile);
+	ofstream eFile(edgeFile);
+	if (!vFile.is_open() || !eFile.is_open()){
+		cout << "Cannot write " << vertexFile << endl;
+		return -1;
+	}
+	for(size_t i = 0; i < sk.vcrit.size(); i++){
+		for(int j = 0; j < sk.dim; j++){
+			vFile << sk.vert[i * (sk.dim + 1) + j] << " ";
+		}
+		vFile << sk.vert[i * (sk.dim + 1) + sk.dim] << " ";
+		vFile << sk.vcrit[i];
+		vFile << endl;
+	}
+	
+	for(size_t i = 0; i < sk.ecrit.size(); i++){
+		eFile << sk.edge[2 * i] << " " << sk.edge[2 * i + 1] << " ";
+		eFile << sk.ecrit[i] << " ";
+		eFile << sk.eval[i];
+		eFile << endl;
+	}
+	return 0;
+}
+
+
+//  State changed by cancellation and arc collection. Saved once after
+//  persistence, it lets the same complex be cancelled again with another
+//  threshold (DiMorSC --serve). Critical simplices removed since the save
+//  are journaled instead of copying the whole critical set.
+struct CancelState{
+	DiscreteVField V;
+	PersistencePairs P;
+	vector<value_t> vf, ef, eval;
+	vector<Simplex*> removed;
+};
+
+
+//  D is the dimension of the vertex coordinates. Each binary instantiates
+//  the dimensions it supports and picks one at startup, so coordinate loops
+//  have a compile-time bound.
+template<int D>
 class Simplicial2Complex{
 	// Connectivity info
 	// access these by index - which works as pointer
 	// Require: no duplicate edge, no duplicate triangles
-	vector<Vertex> vertexList;
+	vector<VertexD<D> > vertexList;
 	vector<Edge> edgeList;
 	vector<Triangle> triList;		// this could be cleared after computing Psudo-Morse function
 	
@@ -40,19 +153,36 @@ class Simplicial2Complex{
 	// stores persistence pairs (index)
 	PersistencePairs P;
 
+	// number of v-e pairs cancelled by cancelPersistencePairs
+	int cancelled;
+
+	// if set, removeCriticalPoint records into journal->removed
+	CancelState *journal;
+
+	// ROI queries, see buildRoiIndex
+	VertexGrid<D> grid;
+	vector<int> adj_first, adj_edge;
+
+	// Morton reordering on load (sfc.h); input ids of the vertices, edges
+	// and triangles, empty if the input order is kept
+	bool reorder_on_load;
+	vector<int> input_vid, input_eid, input_tid;
+
 public:
 	// constructor
 	Simplicial2Complex();
 
 	// modifiers
-	int addVertex(Vertex v);
+	int addVertex(VertexD<D> v);
 	int addEdge(vector<int> &v);
 	int addTriangle(vector<int> &v);
+	void setEdge(int position, int *v);
+	void setTriangle(int position, int *v);
 	void addCriticalPoint(Simplex *s);
 	void removeCriticalPoint(Simplex *s);
 	
 	// access simplex
-	Vertex* atV(int i){
+	VertexD<D>* atV(int i){
 		return &vertexList[i];
 	}
 	Edge* atE(int i){
@@ -64,10 +194,10 @@ public:
 	Vertex* atS(int i){
 		return sorted_vertex[i];
 	}
-	vector<Vertex>::iterator vBegin(){
+	typename vector<VertexD<D> >::iterator vBegin(){
 		return vertexList.begin();
 	}
-	vector<Vertex>::iterator vEnd(){
+	typename vector<VertexD<D> >::iterator vEnd(){
 		return vertexList.end();
 	}
 	vector<Edge>::iterator eBegin(){
@@ -98,6 +228,20 @@ public:
 	// info query
 	bool isCritical(Simplex *s);
 	int order();
+	int vsize(){return vertexList.size();}
+	int esize(){return edgeList.size();}
+	int tsize(){return triList.size();}
+	int fsize(){return filtration.size();}
+	int csize(){return criticalSet.size();}
+	int mssize(){return P.mssize();}
+	int smsize(){return P.smsize();}
+	int cancelsize(){return cancelled;}
+	int inputVertex(int i){return input_vid.empty()? i : input_vid[i];}
+	int inputEdge(int i){return input_eid.empty()? i : input_eid[i];}
+	int inputTriangle(int i){return input_tid.empty()? i : input_tid[i];}
+	
+	// renumber along a Morton curve in the next buildComplexFromArrays
+	void setReorder(bool r){reorder_on_load = r;}
 
 	// connectivity operations
 	vector<int>* get_edge_v(int v){
@@ -135,14 +279,24 @@ public:
 	}
 	
 	// procedural functions
-	void buildComplexFromFile2_BIN(string pathname);
+	void buildComplexFromFile2_BIN(string pathname, int nthreads = 1);
+	void buildComplexFromArrays(const vector<double> &vert,
+		const vector<int> &edge, const vector<int> &tri, int nthreads = 1);
 	void Load_Presaved(string input, string presave);
+	int Load_Snapshot(string snapshot);
 	void updatePsuedoMorseFunction(Edge* e);
-	void buildPsuedoMorseFunction();
-	void buildFiltrationWithLowerStar();
+	void buildPsuedoMorseFunction(int nthreads = 1);
+	void buildFiltrationWithLowerStar(int nthreads = 1);
+	vector<vector<int> > subdomains(int parts);
 	void PhatPersistence();
 	void cancelPersistencePairs(double ve_delta);
 	void outputArcs(string, string, double);
+	void collectArcs(double et_delta, Skeleton &sk, const Roi *roi = NULL);
+	bool collectArc(Edge *e, double et_delta, set<Simplex*> &manifolds);
+	void buildRoiIndex();
+	vector<Edge*> roiSaddles(const Roi &roi);
+	void save_state(CancelState &s);
+	void restore_state(CancelState &s);
 	
 	
 	// helper functions, subroutines.
@@ -156,10 +310,12 @@ public:
 		sort(sorted_vertex.begin(), sorted_vertex.end(), simplexPointerCompare2);
 	}
 	static bool simplexPointerCompare2(const Simplex *s, const Simplex *t);
+	bool edgeCompare(Edge *a, Edge *b);
 	vector<Simplex*> LowerStar(int v);
 	vector<Simplex*>* isCancellable(const persistencePair01&, ofstream&);
 	void cancelAlongVPath(vector<Simplex*>* VPath);
 	void write_presave(string presave);
+	int write_snapshot(string snapshot);
 	
 	// deprecated functions
 	/*
@@ -177,7 +333,8 @@ public:
 };
 
 
-Simplicial2Complex::Simplicial2Complex(){
+template<int D>
+Simplicial2Complex<D>::Simplicial2Complex(){
 	vertexList.clear();
 	edgeList.clear();
 	triList.clear();
@@ -188,10 +345,14 @@ Simplicial2Complex::Simplicial2Complex(){
 	vector<vector<int>* > e2t;
 	vector<vector<int>* > v2e;
 	filtration.clear();
+	cancelled = 0;
+	journal = NULL;
+	reorder_on_load = false;
 	// init V, P
 }
 
-int Simplicial2Complex::addVertex(Vertex v){
+template<int D>
+int Simplicial2Complex<D>::addVertex(VertexD<D> v){
 	int position = vertexList.size();
 	v.setVposition(position);
 	v.setoriposition(position);
@@ -201,7 +362,19 @@ int Simplicial2Complex::addVertex(Vertex v){
 	return position;
 }
 
-int Simplicial2Complex::addEdge(vector<int> &v){
+template<int D>
+int Simplicial2Complex<D>::addEdge(vector<int> &v){
+	int position = edgeList.size();
+	edgeList.push_back(Edge(0, 0));
+	// insert edge to v2e - done outside.
+	setEdge(position, v.data());
+	// addCriticalPoint((Simplex*) &edgeList[position]);
+	return position;
+}
+
+//  Fills edgeList[position]; only reads vertices, so edges can be set in parallel
+template<int D>
+void Simplicial2Complex<D>::setEdge(int position, int *v){
 	// sorted in increasing order, use the inverse
 	if (simplexPointerCompare2(atV(v[1]), atV(v[0]))){
 		swap(v[0], v[1]);
@@ -209,23 +382,33 @@ int Simplicial2Complex::addEdge(vector<int> &v){
 	int v1 = v[1];
 	int v2 = v[0];
 	
-	int position = edgeList.size();
-	
-	// insert edge to v2e - done outside.
-	
 	Edge e(v1, v2);
 	e.setEposition(position);
 	e.critical_type = 0;
 	Vertex* vp[2];
 	vp[0] = atV(v1); vp[1] = atV(v2);
 	e.set_vp(vp);
+	edgeList[position] = e;
+}
 
-	edgeList.push_back(e);
-	// addCriticalPoint((Simplex*) &edgeList[position]);
+template<int D>
+int Simplicial2Complex<D>::addTriangle(vector<int> &v){
+	int position = triList.size();
+	int zero[3] = {0, 0, 0};
+	triList.push_back(Triangle(zero, zero));
+	setTriangle(position, v.data());
+	
+	// addtriangle to e2t
+	int *e = triList[position].getEdges();
+	for (int j = 0; j < 3; j++) e2t[e[j]]->push_back(position);
+	// addCriticalPoint((Simplex*) &triList[position]);
 	return position;
 }
 
-int Simplicial2Complex::addTriangle(vector<int> &v){
+//  Fills triList[position]; only reads vertices and v2e, so triangles can be
+//  set in parallel. e2t is left to the caller.
+template<int D>
+void Simplicial2Complex<D>::setTriangle(int position, int *v){
 	if (simplexPointerCompare2(atV(v[1]), atV(v[0]))){
 		swap(v[1], v[0]);
 	}
@@ -235,55 +418,154 @@ int Simplicial2Complex::addTriangle(vector<int> &v){
 	if (simplexPointerCompare2(atV(v[2]), atV(v[1]))){
 		swap(v[2], v[1]);
 	}
-	int v1 = v[2];
-	int v2 = v[1];
-	int v3 = v[0];
-	int position = triList.size();
-	
-	int e1 = findEdge(v1, v2);
-	int e2 = findEdge(v1, v3);
-	int e3 = findEdge(v2, v3);
-	
-	vector<int> vlist({v1, v2, v3});
-	vector<int> elist({e1, e2, e3});
+	int vlist[3] = {v[2], v[1], v[0]};
+	int elist[3] = {findEdge(vlist[0], vlist[1]), findEdge(vlist[0], vlist[2]),
+					findEdge(vlist[1], vlist[2])};
 	Triangle t(vlist, elist);
-	
-	// addtriangle to e2t
-	e2t[e1]->push_back(position);
-	e2t[e2]->push_back(position);
-	e2t[e3]->push_back(position);
-
 	t.setTposition(position);
 	Vertex* vp[3];
-	vp[0] = atV(v1); vp[1] = atV(v2); vp[2] = atV(v3);
+	vp[0] = atV(vlist[0]); vp[1] = atV(vlist[1]); vp[2] = atV(vlist[2]);
 	t.set_vp(vp);
-	
-	this->triList.push_back(t);
-	// addCriticalPoint((Simplex*) &triList[position]);
-	return position;
+	triList[position] = t;
 }
 
-void Simplicial2Complex::addCriticalPoint(Simplex *s){
+template<int D>
+void Simplicial2Complex<D>::addCriticalPoint(Simplex *s){
 	criticalSet.insert(s);
 }
 
-void Simplicial2Complex::removeCriticalPoint(Simplex *s){
-	criticalSet.erase(s);
+template<int D>
+void Simplicial2Complex<D>::removeCriticalPoint(Simplex *s){
+	if (journal && criticalSet.erase(s)) journal->removed.push_back(s);
+	else criticalSet.erase(s);
 }
 
-bool Simplicial2Complex::isCritical(Simplex *s){
+template<int D>
+bool Simplicial2Complex<D>::isCritical(Simplex *s){
 	return (criticalSet.count(s) > 0);
 }
 
-int Simplicial2Complex::order(){
+template<int D>
+int Simplicial2Complex<D>::order(){
 	return vertexList.size() + edgeList.size() + triList.size();
 }
 
 
 //  Output 1-stable manifold
-void Simplicial2Complex::outputArcs(string vertexFile, string edgeFile, double et_delta){
-	ofstream vFile(vertexFile);
-	ofstream eFile(edgeFile);
+template<int D>
+void Simplicial2Complex<D>::outputArcs(string vertexFile, string edgeFile, double et_delta){
+	Skeleton sk;
+	collectArcs(et_delta, sk);
+	write_skeleton(sk, vertexFile, edgeFile);
+}
+
+
+//  Vertex grid and vertex-edge adjacency for ROI queries. Built on first
+//  use, v2e is not available after Load_Snapshot.
+template<int D>
+void Simplicial2Complex<D>::buildRoiIndex(){
+	size_t nv = vertexList.size();
+	vector<double> coords(nv * D);
+	for (size_t i = 0; i < nv; i++)
+		for (int j = 0; j < D; j++) coords[i * D + j] = vertexList[i].getcoord(j);
+	grid.build(coords);
+	
+	adj_first.assign(nv + 1, 0);
+	for (size_t e = 0; e < edgeList.size(); e++){
+		int *ev = edgeList[e].getVertices();
+		adj_first[ev[0] + 1]++;
+		adj_first[ev[1] + 1]++;
+	}
+	for (size_t i = 0; i < nv; i++) adj_first[i + 1] += adj_first[i];
+	adj_edge.resize(adj_first[nv]);
+	vector<int> pos(adj_first.begin(), adj_first.end() - 1);
+	for (size_t e = 0; e < edgeList.size(); e++){
+		int *ev = edgeList[e].getVertices();
+		adj_edge[pos[ev[0]]++] = e;
+		adj_edge[pos[ev[1]]++] = e;
+	}
+}
+
+
+//  Critical edges whose descending manifold passes through the ROI.
+//  Starting from the ROI vertices, gradient paths are followed backwards:
+//  a vertex w flows into u if w is paired with an edge (w, u). Every vertex
+//  reached this way descends through the ROI, so do the critical edges
+//  incident to it, and no others. Cost depends on the region, not the
+//  whole complex.
+template<int D>
+vector<Edge*> Simplicial2Complex<D>::roiSaddles(const Roi &roi){
+	if (!grid.built()) buildRoiIndex();
+	
+	vector<int> stack;
+	if (!roi.box.empty()){
+		vector<int> cand;
+		grid.query(roi.box.data(), cand);
+		for (auto i : cand){
+			bool inside = true;
+			for (int j = 0; j < D && inside; j++){
+				double x = vertexList[i].getcoord(j);
+				inside = x >= roi.box[j] && x <= roi.box[D + j];
+			}
+			if (inside) stack.push_back(i);
+		}
+	}
+	vector<int> index_of(input_vid.size());
+	for (size_t i = 0; i < input_vid.size(); i++) index_of[input_vid[i]] = i;
+	for (auto i : roi.seeds)
+		if (i >= 0 && i < (int)vertexList.size()) stack.push_back(index_of.empty()? i : index_of[i]);
+		else cout << "Seed " << i << " is not a vertex, ignored" << endl;
+	
+	unordered_set<int> visited(stack.begin(), stack.end());
+	unordered_set<Edge*> saddles;
+	while (!stack.empty()){
+		int u = stack.back();
+		stack.pop_back();
+		for (int k = adj_first[u]; k < adj_first[u + 1]; k++){
+			int e = adj_edge[k];
+			int w = getAdjacentVertex(u, e);
+			if (criticalSet.count((Simplex*)&edgeList[e])) saddles.insert(&edgeList[e]);
+			else if (V.containsVE(w) == e && visited.insert(w).second) stack.push_back(w);
+		}
+	}
+	return vector<Edge*>(saddles.begin(), saddles.end());
+}
+
+
+//  Adds the descending manifold of a critical edge to manifolds, false if
+//  it is below et_delta
+template<int D>
+bool Simplicial2Complex<D>::collectArc(Edge *e, double et_delta, set<Simplex*> &manifolds){
+	// For an e-t pair, if persistence is low, skip it.
+	// thresholds are compared at storage precision, see value_t
+	if (e->critical_type == 2 && e->persistence < (value_t) et_delta + value_eps(et_delta)) return false;
+	
+	updatePsuedoMorseFunction(e);
+	
+	// This value will be used for further simplification.
+	// double support_f = e->funcValue;
+	double support_f = e->persistence;
+	
+	set<Simplex*> *manifold = descendingManifold((Simplex*)e);
+
+	for (set<Simplex*>::iterator it2 = manifold->begin(); it2 != manifold->end(); it2++){
+		if ((*it2)->dim == 1){
+			Edge* te = (Edge*)(*it2);
+			if (te->getEval() < support_f)
+				te->setEval(support_f);
+		}
+		manifolds.insert(*it2);
+	}
+	delete manifold;
+	return true;
+}
+
+
+//  Collect 1-stable manifold
+//  roi (optional): only arcs whose descending manifold passes through it
+//  are kept, edge values are the maximum over the kept arcs.
+template<int D>
+void Simplicial2Complex<D>::collectArcs(double et_delta, Skeleton &sk, const Roi *roi){
 	set<Simplex*> manifolds;
 	cout<< "Writing 1-stable manifold\n";
 	
@@ -299,33 +581,15 @@ void Simplicial2Complex::outputArcs(string vertexFile, string edgeFile, double e
 	cout << "flipped to original vertex function values" << endl;
 	cout << "Collecting 1-stable manifold" << endl;
 	int counter = 0;
-	for(unordered_set<Simplex*>::iterator it = cBegin(); it != cEnd(); it++){
-		//cout << counter << endl;
-		Simplex *s = *it;
-
-		if(s->dim == 1){
-			Edge *e = (Edge*)s;
-			// For an e-t pair, if persistence is low, skip it.
-			if (e->critical_type == 2 && e->persistence < et_delta + EPS_compare) continue;
-			
-			updatePsuedoMorseFunction(e);
-			
-			// This value will be used for further simplification.
-			// double support_f = e->funcValue;
-			double support_f = e->persistence;
-			
-			set<Simplex*> *manifold = descendingManifold((Simplex*)e);
-
-			for (set<Simplex*>::iterator it2 = manifold->begin(); it2 != manifold->end(); it2++){
-				if ((*it2)->dim == 1){
-					Edge* te = (Edge*)(*it2);
-					if (te->getEval() < support_f)
-						te->setEval(support_f);
-				}
-				manifolds.insert(*it2);
-			}
-			delete manifold;
-			counter++;
+	if (roi && !roi->empty()){
+		vector<Edge*> saddles = roiSaddles(*roi);
+		cout << saddles.size() << " critical edges reach the ROI" << endl;
+		for (auto e : saddles)
+			if (collectArc(e, et_delta, manifolds)) counter++;
+	}else{
+		for(unordered_set<Simplex*>::iterator it = cBegin(); it != cEnd(); it++){
+			if((*it)->dim == 1 && collectArc((Edge*)(*it), et_delta, manifolds))
+				counter++;
 		}
 	}
 
@@ -342,22 +606,31 @@ void Simplicial2Complex::outputArcs(string vertexFile, string edgeFile, double e
 			edges.push_back((Edge*)s);
 		}
 	}
+	// same order as the input, whether or not the complex was reordered
+	if (!input_vid.empty()){
+		sort(vertices.begin(), vertices.end(), [&](Vertex *a, Vertex *b){
+			return input_vid[a->getoriPosition()] < input_vid[b->getoriPosition()];
+		});
+		sort(edges.begin(), edges.end(), [&](Edge *a, Edge *b){
+			return input_eid[a->getEPosition()] < input_eid[b->getEPosition()];
+		});
+	}
 	
 	// give vertices a new index - > starting from 1
 	std::map<Vertex*, int> map;
+	sk.dim = D;
 	for(int i = 0; i < vertices.size(); i++){
 		Vertex *v = vertices[i];
 		map.insert( std::pair<Vertex*,int>(v, i + 1));
-		for(int j = 0; j < DIM; j++){
-			vFile << v->getCoords()[j] << " ";
+		for(int j = 0; j < D; j++){
+			sk.vert.push_back(((VertexD<D>*)v)->getcoord(j));
 		}
-		vFile << v->getFuncValue() << " ";
+		sk.vert.push_back(v->getFuncValue());
 		if (this->criticalSet.count((Simplex*)v) > 0){
-			vFile << "0";
+			sk.vcrit.push_back(0);
 		}else{
-			vFile << "-1";
+			sk.vcrit.push_back(-1);
 		}
-		vFile << endl;
 	}
 	
 	for(int i = 0; i < edges.size(); i++){
@@ -365,49 +638,83 @@ void Simplicial2Complex::outputArcs(string vertexFile, string edgeFile, double e
 		int *e_vert = e->getVertices();
 		Vertex* v1 = &vertexList[e_vert[0]];
 		Vertex* v2 = &vertexList[e_vert[1]];
-		eFile << map.find(v1)->second << " " << map.find(v2)->second << " ";
+		sk.edge.push_back(map.find(v1)->second);
+		sk.edge.push_back(map.find(v2)->second);
 		if(this->criticalSet.count((Simplex*)e) > 0){
-			eFile << "1 ";
+			sk.ecrit.push_back(1);
 		}else{
-			eFile << "-1 ";
+			sk.ecrit.push_back(-1);
 		}
-		eFile << e->getEval();
-		eFile << endl;
+		sk.eval.push_back(e->getEval());
 	}
 }
 
 
 //  Load input data
-void Simplicial2Complex::buildComplexFromFile2_BIN(string pathname) {
+template<int D>
+void Simplicial2Complex<D>::buildComplexFromFile2_BIN(string pathname, int nthreads) {
 	// Input filename
 	ifstream file(pathname, ios::binary);
 	
-	char* int_buffer = new char[sizeof(int)];
-	int* int_reader = (int*) int_buffer;
-	char* double_buffer = new char[sizeof(double)];
-	double* double_reader = (double*) double_buffer;
-	
-	
 	// Read vertices.
-	int numOfVertices;
-	file.read(int_buffer, sizeof(int));
-	numOfVertices = *int_reader;	
+	bool v2 = false;
+	int numOfVertices = sc_read_count(file, v2, true);
 	cout << "\tReading " << numOfVertices << "vertices" << endl;
-	vertexList.reserve(numOfVertices);
-	for (int i = 0; i < numOfVertices; i++) {
-		double coords[MAX_DIM];
-		double funcValue;
-		for (int j = 0; j < DIM; j++) {
-			file.read(double_buffer, sizeof(double));
-			coords[j] = *double_reader;
+	vector<double> vert((D + 1) * (size_t)numOfVertices);
+	file.read((char*) vert.data(), sizeof(double) * vert.size());
+	
+	// Read edges.
+	int numOfEdges = sc_read_count(file, v2, false);
+	cout << "\tReading " << numOfEdges << "edges" << endl;
+	vector<int> edge(2 * (size_t)numOfEdges);
+	sc_read_ints(file, v2, edge);
+	
+	// Read triangles.
+	int numOfTris = sc_read_count(file, v2, false);
+	cout << "\tReading " << numOfTris << "triangles" << endl;
+	vector<int> tri(3 * (size_t)numOfTris);
+	sc_read_ints(file, v2, tri);
+	file.close();
+	
+	buildComplexFromArrays(vert, edge, tri, nthreads);
+}
+
+
+//  Build the complex from in-memory arrays in .sc order:
+//  D coordinates + function value per vertex, 2 ids per edge, 3 per triangle.
+//  Simplices are filled in parallel ranges; v2e/e2t and the critical set
+//  are filled in index order, so the result does not depend on nthreads.
+template<int D>
+void Simplicial2Complex<D>::buildComplexFromArrays(const vector<double> &vert,
+		const vector<int> &edge, const vector<int> &tri, int nthreads) {
+	if (reorder_on_load){
+		cout << "\tReordering along a Morton curve" << endl;
+		vector<double> v(vert);
+		vector<int> e(edge), t(tri);
+		morton_reorder<D>(v, e, t, input_vid, input_eid, input_tid);
+		reorder_on_load = false;
+		buildComplexFromArrays(v, e, t, nthreads);
+		return;
+	}
+	sc_check_coords(vert, D);
+	int numOfVertices = vert.size() / (D + 1);
+	int numOfEdges = edge.size() / 2;
+	int numOfTris = tri.size() / 3;
+	criticalSet.reserve((size_t)numOfVertices + numOfEdges + numOfTris);
+	
+	cout << "\tBuilding " << numOfVertices << "vertices" << endl;
+	double zero[D] = {0};
+	vertexList.assign(numOfVertices, VertexD<D>(zero, 0));
+	parallel_for(numOfVertices, nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++){
+			const double *src = &vert[(size_t)i * (D + 1)];
+			VertexD<D> v(src, src[D]);
+			// ties are broken by input order, as without reordering
+			v.setVposition(input_vid.empty()? i : input_vid[i]);
+			v.setoriposition(i);
+			vertexList[i] = v;
 		}
-		file.read(double_buffer, sizeof(double));
-		funcValue = *double_reader;
-		// funcValue = (int)(funcValue*1e5)/1.0e5;
-		
-		Vertex v(coords, funcValue);
-		addVertex(v);		// all related processing moved here.
-	}
+	});
 	for (int i = 0; i < numOfVertices; i++) {
 		addCriticalPoint((Simplex*) atV(i));
 	}
@@ -418,90 +725,70 @@ void Simplicial2Complex::buildComplexFromFile2_BIN(string pathname) {
 	// function value is flipped back before final output.
 	flipAndTranslateVertexFunction();
 	cout << "\tSorting " << numOfVertices << "vertices" << endl;
-	sortVertices();
-	int counter = 0;
-	for (auto i = sBegin(); i < sEnd(); ++i){
-		(*i)->setVposition(counter);
-		counter++;
-	}
+	sorted_vertex.resize(numOfVertices);
+	for (int i = 0; i < numOfVertices; i++) sorted_vertex[i] = &vertexList[i];
+	parallel_sort(sorted_vertex, simplexPointerCompare2, nthreads);
+	parallel_for(numOfVertices, nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++) sorted_vertex[i]->setVposition(i);
+	});
 	cout << "\tDone." << endl;
 	
-	cout << "\tPreparing adjacency graph for vertices" << endl;
-	for (int i = 0; i < numOfVertices; i++){
-		vector<int>* adj_v = new vector<int>;
-		adj_v->reserve(20);
-		v2e.push_back(adj_v);
-	}
-	cout << "\tDone" << endl;
-	
 	
-	// Read edges.
-	int numOfEdges;
-	file.read(int_buffer, sizeof(int));
-	numOfEdges = *int_reader;
-	cout << "\tReading " << numOfEdges << "edges" << endl;
-	edgeList.reserve(numOfEdges);
+	// Edges.
+	cout << "\tBuilding " << numOfEdges << "edges" << endl;
+	edgeList.assign(numOfEdges, Edge(0, 0));
+	parallel_for(numOfEdges, nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++){
+			int e_vert[2] = {edge[2 * (size_t)i], edge[2 * (size_t)i + 1]};
+			setEdge(i, e_vert);
+		}
+	});
+	cout << "\tPreparing adjacency graph for vertices" << endl;
+	v2e.resize(numOfVertices);
+	parallel_for(numOfVertices, nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++){
+			v2e[i] = new vector<int>;
+			v2e[i]->reserve(20);
+		}
+	});
 	for (int i = 0; i < numOfEdges; i++) {
-		int vIndex1, vIndex2;
-		file.read(int_buffer, sizeof(int));
-		vIndex1 = *int_reader;
-		file.read(int_buffer, sizeof(int));
-		vIndex2 = *int_reader;
-		
-		vector<int> e_vert;
-		e_vert.clear(); e_vert.push_back(vIndex1); e_vert.push_back(vIndex2);
-		
-		int e = addEdge(e_vert);
-		// insert edge to v2e
-		v2e[vIndex1]->push_back(e);
-		v2e[vIndex2]->push_back(e);
+		int *ev = edgeList[i].getVertices();
+		v2e[ev[0]]->push_back(i);
+		v2e[ev[1]]->push_back(i);
 	}
 	for (int i = 0; i < numOfEdges; i++) {
 		addCriticalPoint((Simplex*) atE(i));
 	}
 	cout << "\tDone." << endl;
 	
-	cout << "\tPreparing adjacency graph for edges" << endl;
-	for (int i = 0; i < numOfEdges; i++){
-		vector<int>* adj_e = new vector<int>;
-		adj_e->reserve(8);
-		e2t.push_back(adj_e);
-	}
-	cout << "\tDone" << endl;
-	
 	
-	// Read triangles.
-	int numOfTris;
-	file.read(int_buffer, sizeof(int));
-	numOfTris = *int_reader;
-	cout << "\tReading " << numOfTris << "triangles" << endl;
-	triList.reserve(numOfTris);
+	// Triangles.
+	cout << "\tBuilding " << numOfTris << "triangles" << endl;
+	int zero3[3] = {0, 0, 0};
+	triList.assign(numOfTris, Triangle(zero3, zero3));
+	parallel_for(numOfTris, nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++){
+			int t_vert[3] = {tri[3 * (size_t)i], tri[3 * (size_t)i + 1], tri[3 * (size_t)i + 2]};
+			setTriangle(i, t_vert);
+		}
+	});
+	cout << "\tPreparing adjacency graph for edges" << endl;
+	e2t.resize(numOfEdges);
+	parallel_for(numOfEdges, nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++){
+			e2t[i] = new vector<int>;
+			e2t[i]->reserve(8);
+		}
+	});
 	for (int i = 0; i < numOfTris; i++) {
-		int vIndex1, vIndex2, vIndex3;
-		file.read(int_buffer, sizeof(int));
-		vIndex1 = *int_reader;
-		file.read(int_buffer, sizeof(int));
-		vIndex2 = *int_reader;
-		file.read(int_buffer, sizeof(int));
-		vIndex3 = *int_reader;
-		
-		vector<int> t_vert;
-		t_vert.clear();
-		t_vert.push_back(vIndex1); t_vert.push_back(vIndex2);t_vert.push_back(vIndex3);
-		
-		int t = addTriangle(t_vert);
-		// triangles in e2t are inserted.
-		
+		int *te = triList[i].getEdges();
+		for (int j = 0; j < 3; j++) e2t[te[j]]->push_back(i);
 	}
 	for (int i = 0; i < numOfTris; i++) {
 		addCriticalPoint((Simplex*) atT(i));
 	}
 	
-	
 	// at this point, edges triangles ues index in vertexList.
-	delete int_buffer;
-	delete double_buffer;
-	
 	
 	// Debug output stream - output all simplex information in ASCII
 	if (DEBUG){
@@ -519,43 +806,50 @@ void Simplicial2Complex::buildComplexFromFile2_BIN(string pathname) {
 		}
 		simplex_o.close();
 	}
-	file.close();
 	cout << "\tDone." << endl;
 }
 
-void Simplicial2Complex::buildPsuedoMorseFunction(){
+//  Edges take the larger vertex value, triangles the largest edge value.
+//  Each simplex only reads its faces, so ranges are processed in parallel.
+template<int D>
+void Simplicial2Complex<D>::buildPsuedoMorseFunction(int nthreads){
 	cout << "\t Processing "<< edgeList.size() <<" edges\n";
-	for (unsigned int i = 0; i < edgeList.size(); i++){
-		Edge* e = atE(i);
-		int* vertices = e->getVertices();
-		Vertex *max = &vertexList[vertices[0]];
-		Vertex *v2 = &vertexList[vertices[1]];
-		
-		if (v2->getFuncValue() > max->getFuncValue()){
-			max = v2;
+	parallel_for(edgeList.size(), nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++){
+			Edge* e = atE(i);
+			int* vertices = e->getVertices();
+			Vertex *max = &vertexList[vertices[0]];
+			Vertex *v2 = &vertexList[vertices[1]];
+			
+			if (v2->getFuncValue() > max->getFuncValue()){
+				max = v2;
+			}
+			e->setFuncValue(max->getFuncValue());
 		}
-		e->setFuncValue(max->getFuncValue());
-	}
+	});
 
 	cout << "\t Processing "<< triList.size() <<" triangles\n";
-	for (unsigned int i = 0; i < this->triList.size(); i++){
-		Triangle *t = atT(i);
-		int* edges = t->getEdges();
-		Edge *max = atE(edges[0]);
-		Edge *e2 = atE(edges[1]);
-		Edge *e3 = atE(edges[2]);
-
-		if (e2->getFuncValue() > max->getFuncValue()){
-			max = e2;
-		}
-		if (e3->getFuncValue() > max->getFuncValue()){
-			max = e3;
+	parallel_for(triList.size(), nthreads, [&](long a, long b){
+		for (long i = a; i < b; i++){
+			Triangle *t = atT(i);
+			int* edges = t->getEdges();
+			Edge *max = atE(edges[0]);
+			Edge *e2 = atE(edges[1]);
+			Edge *e3 = atE(edges[2]);
+
+			if (e2->getFuncValue() > max->getFuncValue()){
+				max = e2;
+			}
+			if (e3->getFuncValue() > max->getFuncValue()){
+				max = e3;
+			}
+			t->setFuncValue(max->getFuncValue());
 		}
-		t->setFuncValue(max->getFuncValue());
-	}
+	});
 }
 
-void Simplicial2Complex::updatePsuedoMorseFunction(Edge* e){
+template<int D>
+void Simplicial2Complex<D>::updatePsuedoMorseFunction(Edge* e){
 	int* vertices = e->getVertices();
 	Vertex *max = &vertexList[vertices[0]];
 	Vertex *v2 = &vertexList[vertices[1]];
@@ -566,7 +860,8 @@ void Simplicial2Complex::updatePsuedoMorseFunction(Edge* e){
 	e->setFuncValue(max->getFuncValue());
 }
 
-set<Simplex*>* Simplicial2Complex::descendingManifold(Simplex* s){
+template<int D>
+set<Simplex*>* Simplicial2Complex<D>::descendingManifold(Simplex* s){
 	// Discrete Vector Field: V exist here
 	// this is the container for output
 	set<Simplex*> *manifold;
@@ -631,7 +926,8 @@ set<Simplex*>* Simplicial2Complex::descendingManifold(Simplex* s){
 	return manifold;
 }
 
-void Simplicial2Complex::flipAndTranslateVertexFunction(){
+template<int D>
+void Simplicial2Complex<D>::flipAndTranslateVertexFunction(){
 	/*Flip the function and find the maximum function value*/
 	double max = 0;
 	for (int i = 0; i < vertexList.size(); i++){
@@ -647,7 +943,8 @@ void Simplicial2Complex::flipAndTranslateVertexFunction(){
 }
 
 
-int Simplicial2Complex::oppsiteVertex(int e, int t){
+template<int D>
+int Simplicial2Complex<D>::oppsiteVertex(int e, int t){
 	int* tVertices = triList[t].getVertices();
 	int* eVertices = edgeList[e].getVertices();
 	int sum = tVertices[0] + tVertices[1] + tVertices[2]
@@ -657,12 +954,14 @@ int Simplicial2Complex::oppsiteVertex(int e, int t){
 
 
 // tells if the 1st simplex is smaller
-bool Simplicial2Complex::simplexPointerCompare2(const Simplex *s, const Simplex *t){
+template<int D>
+bool Simplicial2Complex<D>::simplexPointerCompare2(const Simplex *s, const Simplex *t){
 	//By function value
 	double f1 = s->funcValue, f2 = t->funcValue;
-	if (f1 < f2 - EPS_compare){
+	double eps = value_eps(f1, f2);
+	if (f1 < f2 - eps){
 		return true;
-	}else if(f1 > f2 + EPS_compare){
+	}else if(f1 > f2 + eps){
 		return false;
 	}
 	else{
@@ -698,7 +997,7 @@ bool Simplicial2Complex::simplexPointerCompare2(const Simplex *s, const Simplex
                 if (e1v[0] != e2v[0])
 					return simplexPointerCompare2((Simplex*)e1v[0], (Simplex*)e2v[0]);
                 else
-                    return e1->Grad() > e2->Grad();
+                    return e1->template Grad<D>() > e2->template Grad<D>();
                 
 			}
 			else{
@@ -722,8 +1021,27 @@ bool Simplicial2Complex::simplexPointerCompare2(const Simplex *s, const Simplex
 }
 
 
+//  simplexPointerCompare2 for two edges. Edges with the same lower vertex
+//  and gradient are ordered by input id, otherwise their order would depend
+//  on where they are in memory.
+template<int D>
+bool Simplicial2Complex<D>::edgeCompare(Edge *a, Edge *b){
+	double f1 = a->funcValue, f2 = b->funcValue;
+	double eps = value_eps(f1, f2);
+	if (f1 < f2 - eps) return true;
+	if (f1 > f2 + eps) return false;
+	Vertex** av = a->get_vp();
+	Vertex** bv = b->get_vp();
+	if (av[0] != bv[0]) return simplexPointerCompare2((Simplex*)av[0], (Simplex*)bv[0]);
+	double ga = a->template Grad<D>(), gb = b->template Grad<D>();
+	if (ga != gb) return ga > gb;
+	return inputEdge(a->getEPosition()) < inputEdge(b->getEPosition());
+}
+
+
 //performs cancellation
-void Simplicial2Complex::cancelAlongVPath(vector<Simplex*>* VPath){
+template<int D>
+void Simplicial2Complex<D>::cancelAlongVPath(vector<Simplex*>* VPath){
 	// V exists
 	// As long as VPath is not empty, we may assume it has at least 2 entries
 	// using original vertex index.
@@ -753,7 +1071,8 @@ void Simplicial2Complex::cancelAlongVPath(vector<Simplex*>* VPath){
 }
 
 /*
-vector<Simplex*> Simplicial2Complex::LowerStar(int v){ // original index - OLD
+template<int D>
+vector<Simplex*> Simplicial2Complex<D>::LowerStar(int v){ // original index - OLD
 	unordered_set<Simplex*> ls;
 	ls.clear();
 	
@@ -787,7 +1106,8 @@ vector<Simplex*> Simplicial2Complex::LowerStar(int v){ // original index - OLD
 }
 */
 
-vector<Simplex*> Simplicial2Complex::LowerStar(int v){ // original index
+template<int D>
+vector<Simplex*> Simplicial2Complex<D>::LowerStar(int v){ // original index
 	unordered_set<Simplex*> ls;
 	ls.clear();
 	
@@ -809,7 +1129,9 @@ vector<Simplex*> Simplicial2Complex::LowerStar(int v){ // original index
 	for (auto s = ls.begin(); s != ls.end(); ++s){
 		edges.push_back(*s);
 	}
-	sort(edges.begin(), edges.end(), simplexPointerCompare2);
+	sort(edges.begin(), edges.end(), [this](Simplex *a, Simplex *b){
+		return edgeCompare((Edge*)a, (Edge*)b);
+	});
     
     // take each sorted edge
     vector<Simplex*> rtn;
@@ -844,32 +1166,84 @@ vector<Simplex*> Simplicial2Complex::LowerStar(int v){ // original index
 }
 
 
-void Simplicial2Complex::buildFiltrationWithLowerStar(){
-	/*Reserve space, so filtration doesn't need to resize as often*/
-	filtration.reserve(order());
-	unordered_set<Simplex*> dup_test;
-	dup_test.clear();
+//  Splits the vertices into parts slabs of about equal size along the
+//  longest axis. The slabs only split the work of a parallel loop: every
+//  thread reads the whole shared complex, nothing is copied per slab.
+template<int D>
+vector<vector<int> > Simplicial2Complex<D>::subdomains(int parts){
+	int nv = vertexList.size();
+	double lo[D], hi[D];
+	for (int d = 0; d < D; d++) lo[d] = hi[d] = nv? vertexList[0].getcoord(d) : 0;
+	for (int i = 0; i < nv; i++)
+		for (int d = 0; d < D; d++){
+			lo[d] = min(lo[d], vertexList[i].getcoord(d));
+			hi[d] = max(hi[d], vertexList[i].getcoord(d));
+		}
+	int axis = 0;
+	for (int d = 1; d < D; d++)
+		if (hi[d] - lo[d] > hi[axis] - lo[axis]) axis = d;
+	
+	// histogram along the axis, cut where the running count reaches i * nv / parts
+	int bins = 64 * parts;
+	double w = max(hi[axis] - lo[axis], 1e-12) / bins;
+	vector<int> bin(nv), count(bins + 1, 0);
+	for (int i = 0; i < nv; i++){
+		bin[i] = min(bins - 1, (int)((vertexList[i].getcoord(axis) - lo[axis]) / w));
+		count[bin[i] + 1]++;
+	}
+	vector<int> part_of_bin(bins);
+	long long seen = 0;
+	for (int b = 0; b < bins; b++){
+		part_of_bin[b] = min(parts - 1, (int)(seen * parts / max(nv, 1)));
+		seen += count[b + 1];
+	}
+	vector<vector<int> > rtn(parts);
+	for (int i = 0; i < nv; i++) rtn[part_of_bin[bin[i]]].push_back(i);
+	return rtn;
+}
+
+
+//  Lower stars only depend on the neighbourhood of a vertex, so they are
+//  computed per slab on nthreads threads. The filtration is then laid
+//  out in sorted vertex order, the same as a sequential run.
+template<int D>
+void Simplicial2Complex<D>::buildFiltrationWithLowerStar(int nthreads){
+	int nv = vertexList.size();
+	vector<vector<Simplex*> > stars(nv);
+	vector<vector<int> > parts = subdomains(max(nthreads, 1));
 	
 	cout << "\tInserting simplicies...";
-	int counter = 0;
-	// use sorted vertex list
-	for (vector<Vertex*>::iterator i = sBegin(); i < sEnd(); ++i){
-		vector<Simplex*> lower_star = LowerStar((*i)->getoriPosition());
-		filtration.push_back(*i);
-		(*i) ->filtrationPosition = counter ++;
-
-		for (vector<Simplex*>::iterator j = lower_star.begin(); j < lower_star.end(); ++j){
-			if (dup_test.count(*j) > 0){
-				cout << "caught duplicate simplex";
-				cout << (*j)->dim << "\n";
-			}else{
-				dup_test.insert(*j);
+	parallel_for(parts.size(), nthreads, [&](long a, long b){
+		for (long p = a; p < b; p++)
+			for (auto v : parts[p]) stars[v] = LowerStar(vertexList[v].getoriPosition());
+	});
+	
+	// start of every vertex in the filtration, in sorted order
+	vector<int> start(nv + 1, 0);
+	for (int r = 0; r < nv; r++)
+		start[r + 1] = start[r] + 1 + stars[sorted_vertex[r]->getoriPosition()].size();
+	filtration.assign(start[nv], NULL);
+	parallel_for(nv, nthreads, [&](long a, long b){
+		for (long r = a; r < b; r++){
+			Vertex *v = sorted_vertex[r];
+			int counter = start[r];
+			filtration[counter] = v;
+			v->filtrationPosition = counter++;
+			for (auto s : stars[v->getoriPosition()]){
+				filtration[counter] = s;
+				s->filtrationPosition = counter++;
 			}
-			filtration.push_back(*j);
-			(*j) ->filtrationPosition = counter ++;
+			vector<Simplex*>().swap(stars[v->getoriPosition()]);
+		}
+	});
+	
+	// a simplex in two lower stars keeps only one position
+	for (size_t j = 0; j < filtration.size(); j++){
+		if (filtration[filtration[j]->filtrationPosition] != filtration[j]){
+			cout << "caught duplicate simplex";
+			cout << filtration[j]->dim << "\n";
 		}
 	}
-	dup_test.clear();
 	
 	if (DEBUG){
 		ofstream filt_o("filtration.txt", ios_base::trunc | ios_base::out);
@@ -890,7 +1264,8 @@ void Simplicial2Complex::buildFiltrationWithLowerStar(){
 }
 
 
-void Simplicial2Complex::PhatPersistence(){
+template<int D>
+void Simplicial2Complex<D>::PhatPersistence(){
 	// generate boundary matrix
 	cout << "\tInitializing boundary matrix...\n";
 	cout << "\t\tMatrix size: " << this->filtration.size() << "\n";
@@ -974,7 +1349,7 @@ void Simplicial2Complex::PhatPersistence(){
 		if (s1->dim == 0){
 			Vertex *v = (Vertex*)s1;
 			Edge *e = (Edge*)s2;
-			double persistence = e->funcValue - v->funcValue;
+			value_t persistence = e->funcValue - v->funcValue;
 			int loc_diff = e->filtrationPosition - v->filtrationPosition;
 			e->critical_type = 1;
 			e->persistence = persistence;
@@ -987,7 +1362,7 @@ void Simplicial2Complex::PhatPersistence(){
 		else{
 			Edge* e = (Edge*)s1;
 			Triangle* t = (Triangle*)s2;
-			double persistence = t->funcValue - e->funcValue;
+			value_t persistence = t->funcValue - e->funcValue;
 			int loc_diff = t->filtrationPosition - e->filtrationPosition;
 			e->critical_type = 2;
 			e->persistence = persistence;
@@ -1005,7 +1380,8 @@ void Simplicial2Complex::PhatPersistence(){
 }
 
 //test cancellability for Edge - vertex pair
-vector<Simplex*>* Simplicial2Complex::isCancellable(const persistencePair01& pp, ofstream& cancelData){
+template<int D>
+vector<Simplex*>* Simplicial2Complex<D>::isCancellable(const persistencePair01& pp, ofstream& cancelData){
 	// V exists here.
 	// DiscreteVField *V = this->K->getDiscreteVField();
 
@@ -1020,7 +1396,7 @@ vector<Simplex*>* Simplicial2Complex::isCancellable(const persistencePair01& pp,
 	}
 
 	// if they have 0 persistence, we know they are cancellable and take this shortcut
-	if (fabs(e->funcValue - v->funcValue) < EPS_compare
+	if (fabs(e->funcValue - v->funcValue) < value_eps(e->funcValue, v->funcValue)
 		&& hasEdge(v->getoriPosition(),e->getEPosition())) {
         if (DEBUG) {
             cancelData << "Yes (trivial)" << endl;
@@ -1140,21 +1516,23 @@ vector<Simplex*>* Simplicial2Complex::isCancellable(const persistencePair01& pp,
 }
 
 //cancels al pairs that can be cancelled
-void Simplicial2Complex::cancelPersistencePairs(double ve_delta){
+template<int D>
+void Simplicial2Complex<D>::cancelPersistencePairs(double ve_delta){
 	cout << "\tSorting "<< P.mssize() << " ms-persistence pairs...\n";
 	cout.flush();
 	P.sortmspair();
 	cout << "\tDone\n";
 	cout.flush();
 
-	ofstream persistencePairs("output/ve_pvalues.txt", ios_base::trunc | ios_base::out);
 	// V exists here.
 
 	#if (DEBUG)
 		ofstream cancelDataVE("cancelData_VE.txt", ios_base::trunc | ios_base::out);
+		ofstream persistencePairs("ve_pvalues.txt", ios_base::trunc | ios_base::out);
 	#else
-		// if not at debug mode, this file will not be created
+		// if not at debug mode, these files will not be created
 		ofstream cancelDataVE;
+		ofstream persistencePairs;
 	#endif
 
 	cout << "\tCancelling...\n";
@@ -1163,7 +1541,7 @@ void Simplicial2Complex::cancelPersistencePairs(double ve_delta){
 	cout << "msPair: " << P.mssize() << "\tsmPair: " << P.smsize() << endl;
 
 	for (auto pair1 = P.msBegin(); pair1 != P.msEnd(); ++pair1){
-		if (pair1->persistence < ve_delta + EPS_compare){
+		if (pair1->persistence < (value_t) ve_delta + value_eps(ve_delta)){
 			vector<Simplex*> *VPath = this->isCancellable(*pair1, cancelDataVE);
 			
 			if (VPath!=NULL){
@@ -1173,16 +1551,16 @@ void Simplicial2Complex::cancelPersistencePairs(double ve_delta){
 				delete VPath;
 				removeCriticalPoint(atS(pair1->min));
 				removeCriticalPoint(atE(pair1->saddle));
-				if (pair1->persistence > EPS_compare){
+				if (pair1->persistence > value_eps(0)){
 					persistencePairs << pair1->persistence << " 1\n";
 				}
 			}else{
-				if (pair1->persistence > EPS_compare){
+				if (pair1->persistence > value_eps(0)){
 					persistencePairs << pair1->persistence << " -1\n";
 				}
 			}
 		}else{
-			if (pair1->persistence > EPS_compare){
+			if (pair1->persistence > value_eps(0)){
 				persistencePairs << pair1->persistence << " -1\n";
 			}
 		}
@@ -1195,46 +1573,104 @@ void Simplicial2Complex::cancelPersistencePairs(double ve_delta){
 		}
 	}
 	
-	cout << "\tWriting smPair info\n";
-	ofstream et_stream("output/et_pvalues.txt", ios_base::trunc | ios_base::out);
-	P.output_sm_pair(et_stream);
-	cout << "\tDone\n";
+	if (DEBUG){
+		cout << "\tWriting smPair info\n";
+		ofstream et_stream("et_pvalues.txt", ios_base::trunc | ios_base::out);
+		P.output_sm_pair(et_stream);
+		cout << "\tDone\n";
+	}
 	
+	cancelled = count;
 	cout << "\t-->msPair: " << count << "/" << P.mssize() <<endl;
 	cout << "\tDone\n";
 	cancelDataVE.close();
 }
 
 
-void Simplicial2Complex::Load_Presaved(string input, string presave){
+//  Presave (<prefix>_presave.bin):
+//	header "DMSCPRES", counts: vertices, VE pairs, ET pairs, bytes per
+//	function value the pairing was computed with (0: 8); checksum
+//	[int * vertices]		sorted rank of every vertex
+//	[PairRecord * VE]		min (sorted rank), saddle, persistence, loc_diff
+//	[PairRecord * ET]		saddle, max, persistence, loc_diff
+//  Each array is one write. Files without the header (older versions) are
+//  read as the same arrays, each preceded by an int32 count except the ranks.
+const char PRESAVE_MAGIC[9] = "DMSCPRES";
+const int PRESAVE_VERSION = 1;
+
+int read_presave(const string &presave, int dim, int numOfVertices, vector<int> &rank,
+				 vector<PairRecord> &ms, vector<PairRecord> &sm){
+	ifstream probe(presave, ios::binary);
+	if (!probe.is_open()){
+		cout << "Cannot open " << presave << endl;
+		return -1;
+	}
+	char magic[8] = {0};
+	probe.read(magic, 8);
+	
+	if (memcmp(magic, PRESAVE_MAGIC, 8) == 0){
+		probe.close();
+		BinReader in;
+		if (in.open(presave, PRESAVE_MAGIC, PRESAVE_VERSION) != 0) return -1;
+		if (in.h.dim != dim || in.h.count[0] != numOfVertices){
+			cout << presave << " was written for another complex ("
+				 << in.h.count[0] << " vertices, dimension " << in.h.dim << ")" << endl;
+			return -1;
+		}
+		if ((in.h.count[3]? in.h.count[3] : 8) != sizeof(value_t)){
+			cout << presave << " was computed with " << (in.h.count[3]? in.h.count[3] : 8)
+				 << "-byte function values, this build stores " << sizeof(value_t) << endl;
+			return -1;
+		}
+		if (in.read(rank, in.h.count[0]) != 0 || in.read(ms, in.h.count[1]) != 0
+			|| in.read(sm, in.h.count[2]) != 0) return -1;
+		return 0;
+	}
+	
+	// headerless presave from older versions
+	probe.seekg(0);
+	int n = 0;
+	rank.resize(numOfVertices);
+	probe.read((char*) rank.data(), sizeof(int) * rank.size());
+	probe.read((char*) &n, sizeof(int));
+	ms.resize(probe? n : 0);
+	probe.read((char*) ms.data(), sizeof(PairRecord) * ms.size());
+	probe.read((char*) &n, sizeof(int));
+	sm.resize(probe? n : 0);
+	probe.read((char*) sm.data(), sizeof(PairRecord) * sm.size());
+	if (!probe){
+		cout << presave << " is truncated" << endl;
+		return -1;
+	}
+	return 0;
+}
+
+
+template<int D>
+void Simplicial2Complex<D>::Load_Presaved(string input, string presave){
 	// almost the same as original reader, but does not sort.
 	// In addition, it reads in persistence pairs.
 	// Input filename
 	ifstream file(input, ios::binary);
 	
-	char* int_buffer = new char[sizeof(int)];
-	int* int_reader = (int*) int_buffer;
-	char* double_buffer = new char[sizeof(double)];
-	double* double_reader = (double*) double_buffer;
-	
 	// Read vertices.
-	int numOfVertices;
-	file.read(int_buffer, sizeof(int));
-	numOfVertices = *int_reader;	
+	bool v2 = false;
+	int numOfVertices = sc_read_count(file, v2, true);
 	cout << "\tReading " << numOfVertices << "vertices" << endl;
+	vector<double> vert((D + 1) * (size_t)numOfVertices);
+	file.read((char*) vert.data(), sizeof(double) * vert.size());
+	sc_check_coords(vert, D);
 	vertexList.reserve(numOfVertices);
 	for (int i = 0; i < numOfVertices; i++) {
-		double coords[MAX_DIM];
-		double funcValue;
-		for (int j = 0; j < DIM; j++) {
-			file.read(double_buffer, sizeof(double));
-			coords[j] = *double_reader;
+		double coords[D];
+		const double *src = &vert[(size_t)i * (D + 1)];
+		for (int j = 0; j < D; j++) {
+			coords[j] = src[j];
 		}
-		file.read(double_buffer, sizeof(double));
-		funcValue = *double_reader;
+		double funcValue = src[D];
 		// funcValue = (int)(funcValue*1e5)/1.0e5;
 		
-		Vertex v(coords, funcValue);
+		VertexD<D> v(coords, funcValue);
 		addVertex(v);		// all related processing moved here.
 	}
 	for (int i = 0; i < numOfVertices; i++) {
@@ -1258,17 +1694,13 @@ void Simplicial2Complex::Load_Presaved(string input, string presave){
 	cout << "\tDone" << endl;
 	
 	// Read edges.
-	int numOfEdges;
-	file.read(int_buffer, sizeof(int));
-	numOfEdges = *int_reader;
+	int numOfEdges = sc_read_count(file, v2, false);
 	cout << "\tReading " << numOfEdges << "edges" << endl;
 	edgeList.reserve(numOfEdges);
 	for (int i = 0; i < numOfEdges; i++) {
 		int vIndex1, vIndex2;
-		file.read(int_buffer, sizeof(int));
-		vIndex1 = *int_reader;
-		file.read(int_buffer, sizeof(int));
-		vIndex2 = *int_reader;
+		vIndex1 = sc_read_int(file, v2);
+		vIndex2 = sc_read_int(file, v2);
 		
 		vector<int> e_vert;
 		e_vert.clear(); e_vert.push_back(vIndex1); e_vert.push_back(vIndex2);
@@ -1292,19 +1724,14 @@ void Simplicial2Complex::Load_Presaved(string input, string presave){
 	cout << "\tDone" << endl;
 	
 	// Read triangles.
-	int numOfTris;
-	file.read(int_buffer, sizeof(int));
-	numOfTris = *int_reader;
+	int numOfTris = sc_read_count(file, v2, false);
 	cout << "\tReading " << numOfTris << "triangles" << endl;
 	triList.reserve(numOfTris);
 	for (int i = 0; i < numOfTris; i++) {
 		int vIndex1, vIndex2, vIndex3;
-		file.read(int_buffer, sizeof(int));
-		vIndex1 = *int_reader;
-		file.read(int_buffer, sizeof(int));
-		vIndex2 = *int_reader;
-		file.read(int_buffer, sizeof(int));
-		vIndex3 = *int_reader;
+		vIndex1 = sc_read_int(file, v2);
+		vIndex2 = sc_read_int(file, v2);
+		vIndex3 = sc_read_int(file, v2);
 		
 		vector<int> t_vert;
 		t_vert.clear();
@@ -1320,53 +1747,34 @@ void Simplicial2Complex::Load_Presaved(string input, string presave){
 	file.close();
 
 	
-	// NEW part - read in Sorted Vert info
-	ifstream pre_stream(presave, ios::binary);
-	sorted_vertex.clear();
-	sorted_vertex.reserve(numOfVertices);
-	cout << "\treading " << numOfVertices << "sorted vertex indices" << endl;
-	for (int i = 0; i < numOfVertices; i++) {
-		Vertex* v = NULL;
-		sorted_vertex.push_back(v);
+	// NEW part - read in Sorted Vert info and simplicial pairs
+	vector<int> rank;
+	vector<PairRecord> ms, sm;
+	if (read_presave(presave, D, numOfVertices, rank, ms, sm) != 0){
+		cout << "Cannot use presave " << presave << endl;
+		exit(1);
 	}
+	sorted_vertex.assign(numOfVertices, NULL);
 	for (int i = 0; i < numOfVertices; i++) {
-		pre_stream.read(int_buffer, sizeof(int));
-		int sorted_idx = *int_reader;
 		Vertex* v = atV(i);
-		v->setVposition(sorted_idx);
-		sorted_vertex[sorted_idx] = atV(i);	// vposition starts with 0
+		v->setVposition(rank[i]);
+		sorted_vertex[rank[i]] = v;	// vposition starts with 0
 	}
 	
-	// NEW - simplicial pairs
-	pre_stream.read(int_buffer, sizeof(int));
-	int num_ve = *int_reader;
-	cout << "\treading " << num_ve << " VE pairs" << endl;
-	for(int i = 0; i<num_ve; ++i){
-		persistencePair01 pp = PersistencePairs::read_ve_pair(pre_stream);
-		P.msinsert(pp);
-		// set E value
-		Edge *e = atE(pp.saddle);
+	cout << "\treading " << ms.size() << " VE pairs, " << sm.size() << " ET pairs" << endl;
+	P.read_pairs(ms.data(), ms.size(), sm.data(), sm.size());
+	// set E value
+	for(auto pp = P.msBegin(); pp != P.msEnd(); ++pp){
+		Edge *e = atE(pp->saddle);
 		e->critical_type = 1;
-		e->persistence = pp.persistence;
+		e->persistence = pp->persistence;
 	}
-	
-	pre_stream.read(int_buffer, sizeof(int));
-	int num_et = *int_reader;
-	cout << "\treading " << num_et << " ET pairs" << endl;
-	for(int i = 0; i<num_et; ++i){
-		persistencePair12 pp = PersistencePairs::read_et_pair(pre_stream);
-		P.sminsert(pp);
-		// set E value
-		Edge *e = atE(pp.saddle);
+	for(auto pp = P.smBegin(); pp != P.smEnd(); ++pp){
+		Edge *e = atE(pp->saddle);
 		e->critical_type = 2;
-		e->persistence = pp.persistence;
+		e->persistence = pp->persistence;
 	}
 	
-	pre_stream.close();
-	
-	delete int_buffer;
-	delete double_buffer;
-	
 	// Debug output stream
 	if (DEBUG){
 		ofstream simplex_o("pre_saved_Simplex.txt", ios_base::trunc | ios_base::out);
@@ -1387,56 +1795,281 @@ void Simplicial2Complex::Load_Presaved(string input, string presave){
 	cout << "\tDone." << endl;
 }
 
-void Simplicial2Complex::write_presave(string presave){
-	// write sorted_vertex index	
+template<int D>
+void Simplicial2Complex<D>::write_presave(string presave){
 	string output_name = presave + "_presave.bin";
-	ofstream pre_stream(output_name, ios::binary);
-	char* int_buffer = new char[sizeof(int)];
-	int* int_writer = (int*) int_buffer;
-	char* double_buffer = new char[sizeof(double)];
-	double* double_writer = (double*) double_buffer;
-
+	BinWriter out;
+	if (out.open(output_name, PRESAVE_MAGIC, PRESAVE_VERSION, D) != 0) return;
+	int num_ve = P.mssize(), num_et = P.smsize();
+	out.h.count[0] = vertexList.size();
+	out.h.count[1] = num_ve;
+	out.h.count[2] = num_et;
+	out.h.count[3] = sizeof(value_t);
+
+	// always in input numbering, Load_Presaved reads the input as is
+	vector<int> rank(vertexList.size());
 	for (int i = 0; i < vertexList.size(); i++) {
-		Vertex* v = atV(i);
-		*int_writer = v->getVPosition();
-		pre_stream.write(int_buffer, sizeof(int));
-	}
-	
-	// write ve pair
-	int num_ve = P.mssize();
-	*int_writer = num_ve;
-	pre_stream.write(int_buffer, sizeof(int));
-
-	for(auto pp = P.msBegin(); pp != P.msEnd(); ++pp){
-		PersistencePairs::write_ve_pair(*pp, pre_stream);
+		rank[inputVertex(i)] = atV(i)->getVPosition();
+	}
+	out.write(rank);
+	if (input_vid.empty()){
+		P.write_pairs(out);
+	}else{
+		PersistencePairs Q;
+		for (auto pp = P.msBegin(); pp != P.msEnd(); ++pp){
+			persistencePair01 q = *pp;
+			q.saddle = inputEdge(q.saddle);
+			Q.msinsert(q);
+		}
+		for (auto pp = P.smBegin(); pp != P.smEnd(); ++pp){
+			persistencePair12 q = *pp;
+			q.saddle = inputEdge(q.saddle);
+			q.max = inputTriangle(q.max);
+			Q.sminsert(q);
+		}
+		Q.write_pairs(out);
 	}
+	if (out.close() != 0) cout << "Error writing " << output_name << endl;
 	
 	if (DEBUG){
 		ofstream ppairs("PersistencePairs.txt", ios::binary);
 		for(auto pp = P.msBegin(); pp != P.msEnd(); ++pp){
 			PersistencePairs::write_ve_pair_debug(*pp, atV(pp->min)->getoriPosition(), ppairs);
 		}
-		ppairs.close();
-	}
-	
-	// write et pair
-	int num_et = P.smsize();
-	*int_writer = num_et;
-	pre_stream.write(int_buffer, sizeof(int));
-
-	for(auto pp = P.smBegin(); pp != P.smEnd(); ++pp){
-		PersistencePairs::write_et_pair(*pp, pre_stream);
-	}
-	if (DEBUG){
-		ofstream ppairs("PersistencePairs.txt", ios::binary|ios::app);
 		for(auto pp = P.smBegin(); pp != P.smEnd(); ++pp){
-			PersistencePairs::write_et_pair_debug(*pp, pre_stream);
+			PersistencePairs::write_et_pair_debug(*pp, ppairs);
 		}
+		ppairs.close();
 	}
 	
-	pre_stream.close();
 	cout << "Written " << vertexList.size() << "int, " << num_ve
 		 << "VE pair, " << num_et << "ET pair." << endl;
-	delete int_buffer;
-	delete double_buffer;
+}
+
+
+//  Complex snapshot (.snap), taken after PhatPersistence.
+//  Holds everything cancellation and arc collection read, as arrays:
+//	vertex	coords (D each), function value (flipped), sorted rank
+//	edge	2 vertices, function value, critical type, persistence
+//	tri		3 vertices, 3 edges, function value
+//	ve/et pairs, one array per field
+//	critical flags, one byte per vertex, edge and triangle
+//	input ids of vertices, edges, triangles, only if reordered (count[5] = 1)
+//  v2e/e2t and the filtration are only used up to PhatPersistence and are
+//  not stored; a restored complex can be cancelled and output, not rebuilt.
+const char SNAP_MAGIC[9] = "DMSCSNAP";
+const int SNAP_VERSION = 1;
+
+template<int D>
+int Simplicial2Complex<D>::write_snapshot(string snapshot){
+	BinWriter out;
+	if (out.open(snapshot, SNAP_MAGIC, SNAP_VERSION, D) != 0) return -1;
+	size_t nv = vertexList.size(), ne = edgeList.size(), nt = triList.size();
+	size_t nms = P.mssize(), nsm = P.smsize();
+	out.h.count[0] = nv; out.h.count[1] = ne; out.h.count[2] = nt;
+	out.h.count[3] = nms; out.h.count[4] = nsm;
+	out.h.count[5] = !input_vid.empty();
+
+	vector<double> d;
+	vector<int> n;
+	d.resize(nv * D);
+	for(size_t i = 0; i < nv; ++i)
+		for(int j = 0; j < D; ++j) d[i * D + j] = vertexList[i].getcoord(j);
+	out.write(d);
+	d.resize(nv);
+	for(size_t i = 0; i < nv; ++i) d[i] = vertexList[i].funcValue;
+	out.write(d);
+	n.resize(nv);
+	for(size_t i = 0; i < nv; ++i) n[i] = vertexList[i].getVPosition();
+	out.write(n);
+
+	n.resize(2 * ne);
+	for(size_t i = 0; i < ne; ++i){
+		n[2 * i] = edgeList[i].getVertices()[0];
+		n[2 * i + 1] = edgeList[i].getVertices()[1];
+	}
+	out.write(n);
+	d.resize(ne);
+	for(size_t i = 0; i < ne; ++i) d[i] = edgeList[i].funcValue;
+	out.write(d);
+	n.resize(ne);
+	for(size_t i = 0; i < ne; ++i) n[i] = edgeList[i].critical_type;
+	out.write(n);
+	for(size_t i = 0; i < ne; ++i) d[i] = edgeList[i].persistence;
+	out.write(d);
+
+	n.resize(6 * nt);
+	for(size_t i = 0; i < nt; ++i)
+		for(int j = 0; j < 3; ++j){
+			n[6 * i + j] = triList[i].getVertices()[j];
+			n[6 * i + 3 + j] = triList[i].getEdges()[j];
+		}
+	out.write(n);
+	d.resize(nt);
+	for(size_t i = 0; i < nt; ++i) d[i] = triList[i].funcValue;
+	out.write(d);
+
+	n.resize(3 * nms);
+	d.resize(nms);
+	size_t k = 0;
+	for(auto pp = P.msBegin(); pp != P.msEnd(); ++pp, ++k){
+		n[3 * k] = pp->min; n[3 * k + 1] = pp->saddle; n[3 * k + 2] = pp->loc_diff;
+		d[k] = pp->persistence;
+	}
+	out.write(n);
+	out.write(d);
+	n.resize(3 * nsm);
+	d.resize(nsm);
+	k = 0;
+	for(auto pp = P.smBegin(); pp != P.smEnd(); ++pp, ++k){
+		n[3 * k] = pp->saddle; n[3 * k + 1] = pp->max; n[3 * k + 2] = pp->loc_diff;
+		d[k] = pp->persistence;
+	}
+	out.write(n);
+	out.write(d);
+
+	vector<char> crit(nv + ne + nt);
+	for(size_t i = 0; i < nv; ++i) crit[i] = isCritical(atV(i));
+	for(size_t i = 0; i < ne; ++i) crit[nv + i] = isCritical(atE(i));
+	for(size_t i = 0; i < nt; ++i) crit[nv + ne + i] = isCritical(atT(i));
+	out.write(crit);
+	if (!input_vid.empty()){
+		out.write(input_vid);
+		out.write(input_eid);
+		out.write(input_tid);
+	}
+
+	if (out.close() != 0){
+		cout << "Error writing " << snapshot << endl;
+		return -1;
+	}
+	cout << "Written snapshot: " << nv << " vertices, " << ne << " edges, " << nt
+		 << " triangles, " << nms << " VE pairs, " << nsm << " ET pairs" << endl;
+	return 0;
+}
+
+
+//  Restores a snapshot into an empty complex, ready for cancelPersistencePairs
+template<int D>
+int Simplicial2Complex<D>::Load_Snapshot(string snapshot){
+	BinReader in;
+	if (in.open(snapshot, SNAP_MAGIC, SNAP_VERSION) != 0) return -1;
+	if (in.h.dim != D){
+		cout << snapshot << " has dimension " << in.h.dim << ", expected " << D << endl;
+		return -1;
+	}
+	size_t nv = in.h.count[0], ne = in.h.count[1], nt = in.h.count[2];
+	size_t nms = in.h.count[3], nsm = in.h.count[4];
+	cout << "\tRestoring " << nv << " vertices, " << ne << " edges, " << nt << " triangles" << endl;
+
+	const double *coords = in.take<double>(nv * D), *vf = in.take<double>(nv);
+	const int *rank = in.take<int>(nv);
+	const int *ev = in.take<int>(2 * ne);
+	const double *ef = in.take<double>(ne);
+	const int *etype = in.take<int>(ne);
+	const double *epers = in.take<double>(ne);
+	const int *tve = in.take<int>(6 * nt);
+	const double *tf = in.take<double>(nt);
+	const int *ms = in.take<int>(3 * nms);
+	const double *mspers = in.take<double>(nms);
+	const int *sm = in.take<int>(3 * nsm);
+	const double *smpers = in.take<double>(nsm);
+	const char *crit = in.take<char>(nv + ne + nt);
+	if (!crit || (in.h.count[5] && (in.read(input_vid, nv) != 0
+		|| in.read(input_eid, ne) != 0 || in.read(input_tid, nt) != 0))){
+		cout << snapshot << " is truncated" << endl;
+		return -1;
+	}
+
+	for(size_t i = 0; i < nv * D; ++i){
+		if (!coord_fits(coords[i])){
+			cout << snapshot << " has coordinate " << coords[i] << ", not a grid position" << endl;
+			return -1;
+		}
+	}
+
+	vertexList.reserve(nv);
+	sorted_vertex.assign(nv, NULL);
+	for(size_t i = 0; i < nv; ++i){
+		double c[D];
+		for(int j = 0; j < D; ++j) c[j] = coords[i * D + j];
+		VertexD<D> v(c, vf[i]);
+		v.setVposition(rank[i]);
+		v.setoriposition(i);
+		vertexList.push_back(v);
+	}
+	for(size_t i = 0; i < nv; ++i) sorted_vertex[rank[i]] = &vertexList[i];
+
+	edgeList.reserve(ne);
+	for(size_t i = 0; i < ne; ++i){
+		Edge e(ev[2 * i], ev[2 * i + 1]);
+		e.setEposition(i);
+		e.funcValue = ef[i];
+		e.critical_type = etype[i];
+		e.persistence = epers[i];
+		Vertex* vp[2] = {atV(ev[2 * i]), atV(ev[2 * i + 1])};
+		e.set_vp(vp);
+		edgeList.push_back(e);
+	}
+
+	triList.reserve(nt);
+	for(size_t i = 0; i < nt; ++i){
+		Triangle t(tve + 6 * i, tve + 6 * i + 3);
+		t.setTposition(i);
+		t.funcValue = tf[i];
+		Vertex* vp[3] = {atV(tve[6 * i]), atV(tve[6 * i + 1]), atV(tve[6 * i + 2])};
+		t.set_vp(vp);
+		triList.push_back(t);
+	}
+
+	for(size_t i = 0; i < nms; ++i){
+		persistencePair01 pp = {ms[3 * i], ms[3 * i + 1], (value_t) mspers[i], ms[3 * i + 2]};
+		P.msinsert(pp);
+	}
+	for(size_t i = 0; i < nsm; ++i){
+		persistencePair12 pp = {sm[3 * i], sm[3 * i + 1], (value_t) smpers[i], sm[3 * i + 2]};
+		P.sminsert(pp);
+	}
+
+	criticalSet.reserve(nv + ne + nt);
+	for(size_t i = 0; i < nv; ++i) if (crit[i]) addCriticalPoint(atV(i));
+	for(size_t i = 0; i < ne; ++i) if (crit[nv + i]) addCriticalPoint(atE(i));
+	for(size_t i = 0; i < nt; ++i) if (crit[nv + ne + i]) addCriticalPoint(atT(i));
+	cout << "\tDone." << endl;
+	return 0;
+}
+
+
+//  Saves the state after persistence and starts journaling removals
+template<int D>
+void Simplicial2Complex<D>::save_state(CancelState &s){
+	s.V = V;
+	s.P = P;
+	s.vf.resize(vertexList.size());
+	for (size_t i = 0; i < vertexList.size(); i++) s.vf[i] = vertexList[i].funcValue;
+	s.ef.resize(edgeList.size());
+	s.eval.resize(edgeList.size());
+	for (size_t i = 0; i < edgeList.size(); i++){
+		s.ef[i] = edgeList[i].funcValue;
+		s.eval[i] = edgeList[i].getEval();
+	}
+	s.removed.clear();
+	journal = &s;
+}
+
+
+//  Rolls back to the saved state
+template<int D>
+void Simplicial2Complex<D>::restore_state(CancelState &s){
+	for (auto r : s.removed) criticalSet.insert(r);
+	s.removed.clear();
+	V = s.V;
+	P = s.P;
+	for (size_t i = 0; i < vertexList.size(); i++) vertexList[i].funcValue = s.vf[i];
+	for (size_t i = 0; i < edgeList.size(); i++){
+		edgeList[i].funcValue = s.ef[i];
+		edgeList[i].setEval(s.eval[i]);
+	}
+	cancelled = 0;
+	journal = &s;
 }
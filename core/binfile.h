@@ -0,0 +1,178 @@
+/*
+Versioned binary files (complex snapshot, presave).
+
+File layout:
+	BinHeader			magic, version, dimension, counts, checksum
+	sections			raw arrays, each padded to 8 bytes
+
+The checksum covers everything after the header. BinReader maps the whole
+file once and hands out pointers into the mapping, so arrays are read with
+a single bulk copy each.
+*/
+
+#ifndef BINFILE_H
+#define BINFILE_H
+
+#include<cstdio>
+#include<cstring>
+#include<string>
+#include<vector>
+#include<fstream>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+
+struct BinHeader{
+	char magic[8];
+	int version;
+	int dim;
+	long long count[6];				// meaning depends on the file type
+	unsigned long long checksum;	// of all bytes after the header
+};
+
+
+// FNV-1a style hash over 8-byte words, the tail is zero padded
+unsigned long long bin_checksum(const char *data, size_t n,
+								unsigned long long h = 14695981039346656037ULL){
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		unsigned long long w;
+		memcpy(&w, data + i, 8);
+		h = (h ^ w) * 1099511628211ULL;
+	}
+	if (i < n){
+		unsigned long long w = 0;
+		memcpy(&w, data + i, n - i);
+		h = (h ^ w) * 1099511628211ULL;
+	}
+	return h;
+}
+
+
+class BinWriter{
+	std::ofstream out;
+	unsigned long long sum;
+
+public:
+	BinHeader h;
+
+	int open(const std::string &filename, const char *magic, int version, int dim){
+		out.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out.is_open()){
+			printf("Cannot write %s\n", filename.c_str());
+			return -1;
+		}
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, magic, 8);
+		h.version = version;
+		h.dim = dim;
+		sum = 14695981039346656037ULL;
+		out.write((char*) &h, sizeof(h));		// rewritten by close()
+		return 0;
+	}
+
+	// one write per array, padded to 8 bytes
+	template<class T>
+	void write(const T *data, size_t n){
+		size_t bytes = sizeof(T) * n;
+		out.write((const char*) data, bytes);
+		sum = bin_checksum((const char*) data, bytes, sum);
+		size_t pad = (8 - bytes % 8) % 8;
+		if (pad){
+			char zero[8] = {0};
+			out.write(zero, pad);
+		}
+	}
+	template<class T>
+	void write(const std::vector<T> &data){
+		write(data.data(), data.size());
+	}
+
+	int close(){
+		h.checksum = sum;
+		out.seekp(0);
+		out.write((char*) &h, sizeof(h));
+		out.close();
+		return out.fail()? -1 : 0;
+	}
+};
+
+
+class BinReader{
+	const char *base;
+	size_t size, pos;
+
+public:
+	BinHeader h;
+
+	BinReader(){base = NULL; size = pos = 0;}
+	~BinReader(){
+		if (base) munmap((void*) base, size);
+	}
+
+	// maps the file and checks magic, version and checksum
+	int open(const std::string &filename, const char *magic, int version){
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0){
+			printf("Cannot open %s\n", filename.c_str());
+			return -1;
+		}
+		struct stat st;
+		fstat(fd, &st);
+		size = st.st_size;
+		if (size < sizeof(BinHeader)){
+			printf("%s is too short\n", filename.c_str());
+			::close(fd);
+			return -1;
+		}
+		void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED){
+			printf("Cannot map %s\n", filename.c_str());
+			return -1;
+		}
+		base = (const char*) p;
+		madvise(p, size, MADV_SEQUENTIAL);
+		memcpy(&h, base, sizeof(h));
+		if (memcmp(h.magic, magic, 8) != 0){
+			printf("%s is not a %.8s file\n", filename.c_str(), magic);
+			return -1;
+		}
+		if (h.version != version){
+			printf("%s has version %d, expected %d\n", filename.c_str(), h.version, version);
+			return -1;
+		}
+		if (bin_checksum(base + sizeof(h), size - sizeof(h)) != h.checksum){
+			printf("%s is corrupt (checksum mismatch)\n", filename.c_str());
+			return -1;
+		}
+		pos = sizeof(h);
+		return 0;
+	}
+
+	// next array of n elements, NULL if the file is too short
+	template<class T>
+	const T* take(size_t n){
+		size_t bytes = sizeof(T) * n;
+		if (pos + bytes > size) return NULL;
+		const T *p = (const T*) (base + pos);
+		pos += bytes + (8 - bytes % 8) % 8;
+		return p;
+	}
+
+	// copies the next array into data
+	template<class T>
+	int read(std::vector<T> &data, size_t n){
+		const T *p = take<T>(n);
+		if (!p && n){
+			printf("Unexpected end of file\n");
+			return -1;
+		}
+		data.assign(p, p + n);
+		return 0;
+	}
+};
+
+#endif
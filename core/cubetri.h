@@ -0,0 +1,170 @@
+/*
+Cube decomposition used to triangulate points on a regular grid.
+
+A unit cube with lower corner (i,j,k) is split into triangles of Type A
+if (i+j+k) is odd and of Type B otherwise. Neighbouring cubes have
+opposite types, so the diagonals on a shared face always agree.
+
+Canonical ownership:
+	A simplex of a cube lies on a face/edge shared with other cubes if all
+	of its vertices have offset 0 (or all 1) along some axis. The sharing
+	cubes are the cube shifted by -1 (or +1) along those axes. Among the
+	sharing cubes that are actually triangulated, the smallest one in
+	(z, y, x) order owns the simplex. Every cube emits only the simplices it
+	owns, so no edge or triangle needs to be deduplicated by hashing.
+*/
+
+#ifndef CUBETRI_H
+#define CUBETRI_H
+
+#include<vector>
+
+// Do not fill inner part of a cube - 12
+// Do     fill inner part of a cube - 16
+const int CubeTri[2][3*16][3] = {
+	{	// Type A
+		{0,0,0}, {1,0,1}, {0,0,1},
+		{0,0,0}, {1,0,0}, {1,0,1},
+		{0,0,0}, {0,1,1}, {0,1,0},
+		{0,0,0}, {0,0,1}, {0,1,1},
+		{0,0,0}, {1,1,0}, {1,0,0},
+		{0,0,0}, {0,1,0}, {1,1,0},
+		{1,0,0}, {1,1,0}, {1,0,1},
+		{1,0,1}, {1,1,0}, {1,1,1},
+		{0,1,0}, {0,1,1}, {1,1,0},
+		{0,1,1}, {1,1,0}, {1,1,1},
+		{0,0,1}, {0,1,1}, {1,0,1},
+		{0,1,1}, {1,1,1}, {1,0,1},
+		{0,0,0}, {0,1,1}, {1,0,1},// fill
+		{0,0,0}, {1,0,1}, {1,1,0},
+		{1,1,0}, {1,0,1}, {0,1,1},
+		{0,0,0}, {1,1,0}, {0,1,1}
+	},
+	{	// Type B
+		{0,0,0}, {0,0,1}, {0,1,0},
+		{0,0,0}, {0,1,0}, {1,0,0},
+		{0,0,0}, {1,0,0}, {0,0,1},
+		{0,1,1}, {0,1,0}, {0,0,1},
+		{0,1,0}, {1,1,0}, {1,0,0},
+		{0,0,1}, {1,0,0}, {1,0,1},
+		{0,1,1}, {1,1,1}, {0,0,1},
+		{0,0,1}, {1,0,1}, {1,1,1},
+		{1,0,1}, {1,1,1}, {1,0,0},
+		{1,0,0}, {1,1,0}, {1,1,1},
+		{0,1,1}, {1,1,1}, {0,1,0},
+		{0,1,0}, {1,1,1}, {1,1,0},
+		{0,0,1}, {0,1,0}, {1,0,0},// fill
+		{0,1,0}, {1,0,0}, {1,1,1},
+		{0,0,1}, {1,1,1}, {1,0,0},
+		{0,0,1}, {1,1,1}, {0,1,0}
+	}
+};
+
+
+// A simplex of the unit cube, stored by corner index (0-7, bit order x,y,z)
+struct CubeSimplex{
+	int n;				// 2 for edges, 3 for triangles
+	int c[3];			// corner indices
+	int nshift;			// number of sharing cubes smaller than this cube
+	int shift[7][3];	// offsets of those cubes
+};
+
+
+struct CubeTable{
+	std::vector<int> corners;			// corners in order of first appearance
+	std::vector<CubeSimplex> edges;
+	std::vector<CubeSimplex> triangles;
+};
+
+
+// Type A: index 0, Type B: index 1. Same convention as triangle_cube.
+CubeTable cube_table[2];
+
+
+inline int cube_corner(const int *off){
+	return off[0] + 2 * off[1] + 4 * off[2];
+}
+
+inline int cube_offset(int corner, int axis){
+	return (corner >> axis) & 1;
+}
+
+inline int cube_type(int i, int j, int k){
+	// same parity rule as triangulation_with_vertex
+	return ((i+j+k)%2==1)? 0 : 1;
+}
+
+
+// Collect cubes that share the simplex and precede the owner in (z,y,x) order
+void cube_shift_init(CubeSimplex &s){
+	int lo[3], hi[3];
+	for(int d = 0; d < 3; ++d){
+		bool all0 = true, all1 = true;
+		for(int v = 0; v < s.n; ++v){
+			if (cube_offset(s.c[v], d)) all0 = false;
+			else all1 = false;
+		}
+		lo[d] = all0? -1 : 0;
+		hi[d] = all1? 1 : 0;
+	}
+	s.nshift = 0;
+	for(int dz = lo[2]; dz <= hi[2]; ++dz)
+		for(int dy = lo[1]; dy <= hi[1]; ++dy)
+			for(int dx = lo[0]; dx <= hi[0]; ++dx){
+				bool smaller = dz < 0 || (dz == 0 && (dy < 0 || (dy == 0 && dx < 0)));
+				if (!smaller) continue;
+				s.shift[s.nshift][0] = dx;
+				s.shift[s.nshift][1] = dy;
+				s.shift[s.nshift][2] = dz;
+				s.nshift++;
+			}
+}
+
+
+// Build per-type tables of distinct corners, edges and triangles for nb triangles
+void cube_init(int nb){
+	for(int AB = 0; AB < 2; ++AB){
+		CubeTable &tab = cube_table[AB];
+		tab.corners.clear(); tab.edges.clear(); tab.triangles.clear();
+		bool seen_corner[8] = {false};
+		bool seen_edge[8][8] = {{false}};
+		for(int cnt = 0; cnt < nb; ++cnt){
+			int c[3];
+			for(int v = 0; v < 3; ++v){
+				c[v] = cube_corner(CubeTri[AB][cnt*3+v]);
+				if (!seen_corner[c[v]]){
+					seen_corner[c[v]] = true;
+					tab.corners.push_back(c[v]);
+				}
+			}
+			CubeSimplex t;
+			t.n = 3; t.c[0] = c[0]; t.c[1] = c[1]; t.c[2] = c[2];
+			cube_shift_init(t);
+			tab.triangles.push_back(t);
+
+			int pairs[3][2] = {{0,1}, {0,2}, {1,2}};
+			for(int p = 0; p < 3; ++p){
+				int a = c[pairs[p][0]], b = c[pairs[p][1]];
+				if (seen_edge[a][b]) continue;
+				seen_edge[a][b] = seen_edge[b][a] = true;
+				CubeSimplex e;
+				e.n = 2; e.c[0] = a; e.c[1] = b; e.c[2] = -1;
+				cube_shift_init(e);
+				tab.edges.push_back(e);
+			}
+		}
+	}
+}
+
+
+// True if cube (i,j,k) owns s. is_seed(x,y,z) tells whether a cube is triangulated.
+template<class SeedFn>
+bool cube_owns(int i, int j, int k, const CubeSimplex &s, SeedFn &is_seed){
+	for(int n = 0; n < s.nshift; ++n){
+		if (is_seed(i + s.shift[n][0], j + s.shift[n][1], k + s.shift[n][2]))
+			return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+Run metrics shared by the binaries.
+Stages are timed with scoped timers (wall clock, CPU time of all threads and
+peak resident memory at the end of the stage), counters hold sizes such as
+simplices or persistence pairs. The report is written as JSON:
+
+	{"binary": ..., "wall": s, "cpu": s, "peak_rss_kb": kb,
+	 "stages": [{"name": ..., "wall": s, "cpu": s, "peak_rss_kb": kb}, ...],
+	 "counters": {"vertices": n, ...}}
+
+Usage:
+	Metrics M("DiMorSC");
+	{
+		Stage s(M, "persistence");
+		...
+		cout << "Done in " << s.stop() << endl;		// or recorded when s leaves scope
+	}
+	M.count("pairs", n);
+	M.write(prefix + "_metrics.json");
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include<cstdio>
+#include<chrono>
+#include<string>
+#include<vector>
+#include<fstream>
+#include<utility>
+#include<sys/time.h>
+#include<sys/resource.h>
+
+
+class Metrics{
+public:
+	struct Record{
+		std::string name;
+		double wall, cpu;
+		long rss;
+	};
+
+private:
+	std::string binary;
+	std::chrono::steady_clock::time_point t0;
+	double cpu0;
+	std::vector<Record> stages;
+	std::vector<std::pair<std::string, long long> > counters;	// in insertion order
+
+	static std::string quote(const std::string &s){
+		std::string r = "\"";
+		for(char c : s){
+			if (c == '"' || c == '\\') r += '\\';
+			r += c;
+		}
+		return r + "\"";
+	}
+
+public:
+	Metrics(const std::string &name){
+		binary = name;
+		t0 = std::chrono::steady_clock::now();
+		cpu0 = cpu_seconds();
+	}
+
+	// user + system time of the process, all threads included
+	static double cpu_seconds(){
+		struct rusage u;
+		getrusage(RUSAGE_SELF, &u);
+		return u.ru_utime.tv_sec + u.ru_stime.tv_sec
+			   + (u.ru_utime.tv_usec + u.ru_stime.tv_usec) * 1e-6;
+	}
+
+	// high-water resident set size in KB
+	static long peak_rss(){
+		struct rusage u;
+		getrusage(RUSAGE_SELF, &u);
+		return u.ru_maxrss;
+	}
+
+	double elapsed() const{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	}
+
+	void record(const std::string &name, double wall, double cpu){
+		Record r = {name, wall, cpu, peak_rss()};
+		stages.push_back(r);
+	}
+
+	// sets a counter, repeated names overwrite
+	void count(const std::string &name, long long value){
+		for(auto &c : counters)
+			if (c.first == name){
+				c.second = value;
+				return;
+			}
+		counters.push_back(std::make_pair(name, value));
+	}
+
+	void add(const std::string &name, long long delta){
+		for(auto &c : counters)
+			if (c.first == name){
+				c.second += delta;
+				return;
+			}
+		counters.push_back(std::make_pair(name, delta));
+	}
+
+	int write(const std::string &filename) const{
+		std::ofstream out(filename);
+		if (!out.is_open()){
+			printf("Cannot write metrics to %s\n", filename.c_str());
+			return -1;
+		}
+		out.precision(6);
+		out << std::fixed;
+		out << "{\n\t\"binary\": " << quote(binary) << ",\n";
+		out << "\t\"wall\": " << elapsed() << ",\n";
+		out << "\t\"cpu\": " << cpu_seconds() - cpu0 << ",\n";
+		out << "\t\"peak_rss_kb\": " << peak_rss() << ",\n";
+		out << "\t\"stages\": [";
+		for(size_t i = 0; i < stages.size(); ++i){
+			const Record &r = stages[i];
+			out << (i? ",\n" : "\n") << "\t\t{\"name\": " << quote(r.name) << ", \"wall\": " << r.wall
+				<< ", \"cpu\": " << r.cpu << ", \"peak_rss_kb\": " << r.rss << "}";
+		}
+		out << (stages.empty()? "],\n" : "\n\t],\n");
+		out << "\t\"counters\": {";
+		for(size_t i = 0; i < counters.size(); ++i)
+			out << (i? ",\n" : "\n") << "\t\t" << quote(counters[i].first) << ": " << counters[i].second;
+		out << (counters.empty()? "}\n" : "\n\t}\n");
+		out << "}\n";
+		return 0;
+	}
+};
+
+
+// Times a stage from construction until stop() or the end of the scope.
+class Stage{
+	Metrics &m;
+	std::string name;
+	std::chrono::steady_clock::time_point start;
+	double cpu;
+	double wall;
+	bool done;
+
+public:
+	Stage(Metrics &metrics, const std::string &stage_name) : m(metrics){
+		name = stage_name;
+		done = false;
+		wall = 0;
+		cpu = Metrics::cpu_seconds();
+		start = std::chrono::steady_clock::now();
+	}
+
+	// records the stage once and returns its wall time in seconds
+	double stop(){
+		if (!done){
+			wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			m.record(name, wall, Metrics::cpu_seconds() - cpu);
+			done = true;
+		}
+		return wall;
+	}
+
+	~Stage(){
+		stop();
+	}
+};
+
+#endif
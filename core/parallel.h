@@ -0,0 +1,59 @@
+/*
+Small std::thread helpers.
+Work is split into contiguous ranges so results can be written without locks.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include<vector>
+#include<thread>
+#include<algorithm>
+
+
+// fn(begin, end) on nthreads contiguous ranges of [0, n)
+template<class Fn>
+void parallel_for(long n, int nthreads, Fn fn){
+	if (nthreads <= 1 || n < 2){
+		fn(0L, n);
+		return;
+	}
+	std::vector<std::thread> pool;
+	for(int t = 0; t < nthreads; ++t){
+		long a = n * t / nthreads, b = n * (t + 1) / nthreads;
+		pool.push_back(std::thread(fn, a, b));
+	}
+	for(auto &th : pool) th.join();
+}
+
+
+// Sorts chunks in parallel, then merges neighbouring runs pairwise.
+// cmp must be a strict total order for the result not to depend on nthreads.
+template<class T, class Cmp>
+void parallel_sort(std::vector<T> &data, Cmp cmp, int nthreads){
+	long n = data.size();
+	if (nthreads <= 1 || n < 4096){
+		std::sort(data.begin(), data.end(), cmp);
+		return;
+	}
+	std::vector<long> bound;
+	for(int t = 0; t <= nthreads; ++t) bound.push_back(n * t / nthreads);
+	parallel_for(nthreads, nthreads, [&](long a, long b){
+		for(long t = a; t < b; ++t)
+			std::sort(data.begin() + bound[t], data.begin() + bound[t + 1], cmp);
+	});
+	while (bound.size() > 2){
+		std::vector<long> next;
+		long runs = bound.size() - 1;
+		parallel_for(runs / 2, nthreads, [&](long a, long b){
+			for(long r = a; r < b; ++r)
+				std::inplace_merge(data.begin() + bound[2 * r], data.begin() + bound[2 * r + 1],
+								   data.begin() + bound[2 * r + 2], cmp);
+		});
+		for(long r = 0; r < runs; r += 2) next.push_back(bound[r]);
+		next.push_back(n);
+		bound.swap(next);
+	}
+}
+
+#endif
@@ -21,6 +21,8 @@
 
 #include <phat/helpers/dualize.h>
 
+#include "binfile.h"
+
 
 using namespace std;
 
@@ -31,7 +33,7 @@ typedef struct {
 	// because we need the sorted vertex info for persistence pair sorting.
 	int min;
 	int saddle;
-	double persistence;
+	value_t persistence;
 	int loc_diff;
 }persistencePair01;
 
@@ -41,11 +43,21 @@ typedef struct {
 typedef struct {
 	int saddle;
 	int max;
-	double persistence;
+	value_t persistence;
 	int loc_diff;
 }persistencePair12;
 
 
+//  On-disk pair: min/saddle (v-e) or saddle/max (e-t), 20 bytes, no padding
+#pragma pack(push, 1)
+struct PairRecord{
+	int a, b;
+	double persistence;
+	int loc_diff;
+};
+#pragma pack(pop)
+
+
 //  Container of all pairs
 class PersistencePairs{
 	/*ms: min-saddle or 0-1
@@ -63,10 +75,11 @@ public:
 	
 	//  Compares v-e pair
 	static bool persistencePairCompare01(const persistencePair01& p, const persistencePair01& q){
-		if(p.persistence < q.persistence - EPS_compare){
+		value_t eps = value_eps(p.persistence, q.persistence);
+		if(p.persistence < q.persistence - eps){
 			return true;
 		}
-		else if (p.persistence > q.persistence + EPS_compare){
+		else if (p.persistence > q.persistence + eps){
 			return false;
 		}else{
 			if (p.loc_diff < q.loc_diff)
@@ -88,10 +101,8 @@ public:
 	
 	
 	//  data r/w interface
-	static persistencePair01 read_ve_pair(ifstream &presave);
-	static persistencePair12 read_et_pair(ifstream &presave);
-	static void write_ve_pair(persistencePair01, ofstream& presave);
-	static void write_et_pair(persistencePair12, ofstream& presave);
+	void write_pairs(BinWriter &out);
+	void read_pairs(const PairRecord *ms, size_t nms, const PairRecord *sm, size_t nsm);
 	static void write_ve_pair_debug(persistencePair01, int, ofstream&);
 	static void write_et_pair_debug(persistencePair12, ofstream&);
 	
@@ -131,7 +142,7 @@ public:
 		vector<persistencePair12> nz_sm_pair;
 		nz_sm_pair.clear();
 		for(auto pp = smBegin(); pp!=smEnd(); ++pp){
-			if (pp->persistence > EPS_compare)
+			if (pp->persistence > value_eps(0))
 				nz_sm_pair.push_back(*pp);
 		}
 		cout << "\t" << nz_sm_pair.size() << " non-zero persistence pairs\n";
@@ -144,81 +155,35 @@ public:
 	
 };
 
-persistencePair01 PersistencePairs::read_ve_pair(ifstream &presave){
-	char* int_buffer = new char[sizeof(int)];
-	int* int_reader = (int*) int_buffer;
-	char* double_buffer = new char[sizeof(double)];
-	double* double_reader = (double*) double_buffer;
-	
-	persistencePair01 pp;
-	presave.read(int_buffer, sizeof(int));
-	pp.min = *int_reader;
-	presave.read(int_buffer, sizeof(int));
-	pp.saddle = *int_reader;
-	presave.read(double_buffer, sizeof(double));
-	pp.persistence = *double_reader;
-	presave.read(int_buffer, sizeof(int));
-	pp.loc_diff = *int_reader;
-	
-	delete int_buffer;
-	delete double_buffer;
-	return pp;
-}
-persistencePair12 PersistencePairs::read_et_pair(ifstream &presave){
-	char* int_buffer = new char[sizeof(int)];
-	int* int_reader = (int*) int_buffer;
-	char* double_buffer = new char[sizeof(double)];
-	double* double_reader = (double*) double_buffer;
-	
-	persistencePair12 pp;
-	presave.read(int_buffer, sizeof(int));
-	pp.saddle = *int_reader;
-	presave.read(int_buffer, sizeof(int));
-	pp.max = *int_reader;
-	presave.read(double_buffer, sizeof(double));
-	pp.persistence = *double_reader;
-	presave.read(int_buffer, sizeof(int));
-	pp.loc_diff = *int_reader;
-	
-	delete int_buffer;
-	delete double_buffer;
-	return pp;
-}
-void PersistencePairs::write_ve_pair(persistencePair01 pp, ofstream& presave){
-	char* int_buffer = new char[sizeof(int)];
-	int* int_writer = (int*) int_buffer;
-	char* double_buffer = new char[sizeof(double)];
-	double* double_writer = (double*) double_buffer;
-	
-	*int_writer = pp.min;
-	presave.write(int_buffer, sizeof(int));
-	*int_writer = pp.saddle;
-	presave.write(int_buffer, sizeof(int));
-	*double_writer = pp.persistence;
-	presave.write(double_buffer, sizeof(double));
-	*int_writer = pp.loc_diff;
-	presave.write(int_buffer, sizeof(int));
-	
-	delete int_buffer;
-	delete double_buffer;
+//  Pairs are stored as arrays of packed records, written and read in one call
+void PersistencePairs::write_pairs(BinWriter &out){
+	vector<PairRecord> rec(msPersistencePairs.size());
+	for(size_t i = 0; i < rec.size(); ++i){
+		const persistencePair01 &pp = msPersistencePairs[i];
+		PairRecord r = {pp.min, pp.saddle, pp.persistence, pp.loc_diff};
+		rec[i] = r;
+	}
+	out.write(rec);
+	rec.resize(smPersistencePairs.size());
+	for(size_t i = 0; i < rec.size(); ++i){
+		const persistencePair12 &pp = smPersistencePairs[i];
+		PairRecord r = {pp.saddle, pp.max, pp.persistence, pp.loc_diff};
+		rec[i] = r;
+	}
+	out.write(rec);
 }
-void PersistencePairs::write_et_pair(persistencePair12 pp, ofstream& presave){
-	char* int_buffer = new char[sizeof(int)];
-	int* int_writer = (int*) int_buffer;
-	char* double_buffer = new char[sizeof(double)];
-	double* double_writer = (double*) double_buffer;
-	
-	*int_writer = pp.saddle;
-	presave.write(int_buffer, sizeof(int));
-	*int_writer = pp.max;
-	presave.write(int_buffer, sizeof(int));
-	*double_writer = pp.persistence;
-	presave.write(double_buffer, sizeof(double));
-	*int_writer = pp.loc_diff;
-	presave.write(int_buffer, sizeof(int));
-	
-	delete int_buffer;
-	delete double_buffer;
+
+void PersistencePairs::read_pairs(const PairRecord *ms, size_t nms, const PairRecord *sm, size_t nsm){
+	msPersistencePairs.resize(nms);
+	for(size_t i = 0; i < nms; ++i){
+		persistencePair01 pp = {ms[i].a, ms[i].b, (value_t) ms[i].persistence, ms[i].loc_diff};
+		msPersistencePairs[i] = pp;
+	}
+	smPersistencePairs.resize(nsm);
+	for(size_t i = 0; i < nsm; ++i){
+		persistencePair12 pp = {sm[i].a, sm[i].b, (value_t) sm[i].persistence, sm[i].loc_diff};
+		smPersistencePairs[i] = pp;
+	}
 }
 
 void PersistencePairs::write_ve_pair_debug(persistencePair01 pp, int ori, ofstream& ppair){
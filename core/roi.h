@@ -0,0 +1,127 @@
+/*
+Region of interest for skeleton extraction.
+
+An ROI is either an axis-aligned box (D lower corner, D upper corner)
+or a list of seed vertices (input indices, starting from 0). Only critical
+edges whose descending manifold passes through the region are output.
+
+Text form, used by DiMorSC (ROI file) and DiMorSC --serve:
+	box x0 y0 (z0) x1 y1 (z1)
+	seeds v0 v1 ...
+	x0 y0 (z0) x1 y1 (z1)		same as box
+
+VertexGrid is a uniform grid over vertex coordinates with about
+VERTS_PER_CELL vertices per cell, stored as one sorted array, so a box query
+only touches the cells overlapping the box.
+*/
+
+#ifndef ROI_H
+#define ROI_H
+
+#include<cmath>
+#include<cstdlib>
+#include<string>
+#include<vector>
+#include<istream>
+#include<algorithm>
+
+
+struct Roi{
+	std::vector<double> box;	// 2 * dim values, or empty
+	std::vector<int> seeds;
+	bool empty() const {return box.empty() && seeds.empty();}
+};
+
+
+// reads an ROI in text form for dim coordinates, -1 on malformed input
+int parse_roi(std::istream &in, Roi &roi, int dim){
+	roi.box.clear();
+	roi.seeds.clear();
+	std::string word;
+	if (!(in >> word)) return 0;
+	if (word == "seeds"){
+		int v;
+		while (in >> v) roi.seeds.push_back(v);
+		return roi.seeds.empty()? -1 : 0;
+	}
+	if (word != "box") roi.box.push_back(atof(word.c_str()));
+	double x;
+	while (in >> x) roi.box.push_back(x);
+	return (int)roi.box.size() == 2 * dim? 0 : -1;
+}
+
+
+template<int D>
+class VertexGrid{
+	static const int VERTS_PER_CELL = 8;
+	double lo[D], cell;
+	int res[D];
+	std::vector<int> first;		// first[c] .. first[c + 1]: vertices of cell c
+	std::vector<int> verts;
+
+	int cell_of(int d, double x) const {
+		int i = (int)floor((x - lo[d]) / cell);
+		return std::min(std::max(i, 0), res[d] - 1);
+	}
+
+public:
+	// coords: D values per vertex
+	void build(const std::vector<double> &coords){
+		int n = coords.size() / D;
+		double hi[D], volume = 1;
+		for (int d = 0; d < D; d++){
+			lo[d] = hi[d] = n? coords[d] : 0;
+		}
+		for (int i = 0; i < n; i++)
+			for (int d = 0; d < D; d++){
+				lo[d] = std::min(lo[d], coords[i * D + d]);
+				hi[d] = std::max(hi[d], coords[i * D + d]);
+			}
+		for (int d = 0; d < D; d++) volume *= std::max(hi[d] - lo[d], 1.0);
+		cell = pow(volume * VERTS_PER_CELL / std::max(n, 1), 1.0 / D);
+		long long cells = 1;
+		for (int d = 0; d < D; d++){
+			res[d] = std::max(1, (int)((hi[d] - lo[d]) / cell) + 1);
+			cells *= res[d];
+		}
+
+		// counting sort by cell
+		std::vector<int> c(n);
+		first.assign(cells + 1, 0);
+		for (int i = 0; i < n; i++){
+			long long id = 0;
+			for (int d = D - 1; d >= 0; d--) id = id * res[d] + cell_of(d, coords[i * D + d]);
+			c[i] = id;
+			first[id + 1]++;
+		}
+		for (long long k = 0; k < cells; k++) first[k + 1] += first[k];
+		verts.resize(n);
+		std::vector<int> pos(first.begin(), first.end() - 1);
+		for (int i = 0; i < n; i++) verts[pos[c[i]]++] = i;
+	}
+
+	bool built() const {return !first.empty();}
+
+	// vertices of the cells overlapping box, to be checked by the caller
+	void query(const double *box, std::vector<int> &out) const {
+		int a[D], b[D], k[D];
+		for (int d = 0; d < D; d++){
+			if (box[d] > box[D + d]) return;
+			a[d] = k[d] = cell_of(d, box[d]);
+			b[d] = cell_of(d, box[D + d]);
+		}
+		while (true){
+			long long id = 0;
+			for (int d = D - 1; d >= 0; d--) id = id * res[d] + k[d];
+			out.insert(out.end(), verts.begin() + first[id], verts.begin() + first[id + 1]);
+			int d = 0;
+			while (d < D && ++k[d] > b[d]){
+				k[d] = a[d];
+				d++;
+			}
+			if (d == D) break;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,169 @@
+/*
+Resident mode of DiMorSC (DiMorSC --serve).
+
+The complex is loaded and paired once; afterwards each request rolls the
+gradient field and function values back to the state after persistence
+(Simplicial2Complex::save_state / restore_state) and runs cancellation and
+output with its own thresholds.
+
+Requests, one per line:
+	<ve_delta> <et_delta> <output_prefix> [roi]
+	quit
+
+	The optional roi (see roi.h) keeps only arcs whose descending manifold
+	passes through it.
+	Output is <output_prefix>_vert.txt / _edge.txt, as in a normal run.
+
+Replies, one line per request:
+	ok <vertices> <edges> <seconds>
+	error <message>
+
+Over stdin the replies go to stdout and all log output is moved to stderr.
+Over a Unix socket clients are served one after another; "quit" ends the
+connection, "shutdown" stops the server.
+*/
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<string>
+#include<sstream>
+#include<chrono>
+#include<unistd.h>
+#include<signal.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+
+
+// the whole of word as a number
+bool parse_threshold(const string &word, double &x){
+	char *end;
+	x = strtod(word.c_str(), &end);
+	return end != word.c_str() && *end == 0;
+}
+
+
+// 1: stop serving, 0: next request
+template<int D>
+int serve_request(Simplicial2Complex<D> &K, CancelState &base, const string &line, FILE *reply){
+	istringstream in(line);
+	string first;
+	if (!(in >> first)) return 0;
+	if (first == "quit" || first == "shutdown") return 1;
+
+	string second, prefix;
+	double ve_delta, et_delta;
+	if (!(in >> second >> prefix)){
+		fprintf(reply, "error expected <ve_delta> <et_delta> <output_prefix> [roi]\n");
+		fflush(reply);
+		return 0;
+	}
+	if (!parse_threshold(first, ve_delta) || !parse_threshold(second, et_delta)){
+		fprintf(reply, "error threshold is not a number: %s\n",
+				(parse_threshold(first, ve_delta)? second : first).c_str());
+		fflush(reply);
+		return 0;
+	}
+	Roi roi;
+	if (parse_roi(in, roi, D) != 0){
+		fprintf(reply, "error ROI is \"box\" and %d values or \"seeds\" and vertex indices\n", 2 * D);
+		fflush(reply);
+		return 0;
+	}
+
+	auto t0 = chrono::steady_clock::now();
+	K.restore_state(base);
+	K.cancelPersistencePairs(ve_delta);
+	Skeleton sk;
+	K.collectArcs(et_delta, sk, &roi);
+	if (write_skeleton(sk, prefix + "_vert.txt", prefix + "_edge.txt") != 0){
+		fprintf(reply, "error cannot write %s\n", prefix.c_str());
+		fflush(reply);
+		return 0;
+	}
+	double t = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	fprintf(reply, "ok %d %d %.6f\n", (int)sk.vcrit.size(), (int)sk.ecrit.size(), t);
+	fflush(reply);
+	return 0;
+}
+
+
+// requests from f until quit or end of input; 1 if shutdown was requested
+template<int D>
+int serve_stream(Simplicial2Complex<D> &K, CancelState &base, FILE *f, FILE *reply){
+	char *buf = NULL;
+	size_t cap = 0;
+	int stop = 0;
+	while (!stop && getline(&buf, &cap, f) != -1){
+		string line(buf);
+		stop = serve_request(K, base, line, reply);
+		if (stop && line.compare(0, 8, "shutdown") == 0) stop = 2;
+	}
+	free(buf);
+	return stop == 2;
+}
+
+
+// keeps stdout for replies, everything printed afterwards goes to stderr
+FILE* take_stdout(){
+	cout.flush();
+	fflush(stdout);
+	FILE *reply = fdopen(dup(1), "w");
+	dup2(2, 1);
+	return reply;
+}
+
+
+// reply: stdout taken by take_stdout() to serve stdin, NULL to serve socket_path
+template<int D>
+int serve(Simplicial2Complex<D> &K, FILE *reply, string socket_path){
+	CancelState base;
+	K.save_state(base);
+
+	if (reply){
+		fprintf(reply, "ready\n");
+		fflush(reply);
+		serve_stream(K, base, stdin, reply);
+		fclose(reply);
+		return 0;
+	}
+
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (s < 0 || socket_path.size() >= sizeof(addr.sun_path)){
+		cout << "Cannot create socket " << socket_path << endl;
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path.c_str());
+	unlink(socket_path.c_str());
+	if (bind(s, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(s, 4) != 0){
+		cout << "Cannot listen on " << socket_path << endl;
+		close(s);
+		return -1;
+	}
+	cout << "Serving on " << socket_path << endl;
+	signal(SIGPIPE, SIG_IGN);		// a client leaving early must not stop the server
+
+	int stop = 0;
+	while (!stop){
+		int c = accept(s, NULL, NULL);
+		if (c < 0) continue;
+		FILE *f = fdopen(c, "r");
+		FILE *reply = fdopen(dup(c), "w");
+		fprintf(reply, "ready\n");
+		fflush(reply);
+		stop = serve_stream(K, base, f, reply);
+		fclose(reply);
+		fclose(f);
+	}
+	close(s);
+	unlink(socket_path.c_str());
+	return 0;
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+Space-filling-curve order for a complex in .sc arrays.
+
+Vertices are renumbered along a Morton (Z-order) curve of their coordinates,
+edges and triangles by their smallest renumbered vertex, so simplices that
+are close in space are close in memory. Ties keep the input order, so the
+result only depends on the input.
+
+The arrays are permuted in place; vid/eid/tid map new ids to input ids.
+*/
+
+#ifndef SFC_H
+#define SFC_H
+
+#include<vector>
+#include<algorithm>
+
+
+// interleaves the top 63 / D bits of every coordinate, lo..hi scaled to the full range
+template<int D>
+unsigned long long morton_code(const double *x, const double *lo, const double *scale){
+	int bits = 63 / D;
+	unsigned long long c[D], code = 0;
+	for (int d = 0; d < D; d++) c[d] = (unsigned long long)((x[d] - lo[d]) * scale[d]);
+	for (int b = bits - 1; b >= 0; b--)
+		for (int d = D - 1; d >= 0; d--)
+			code = code << 1 | (c[d] >> b & 1);
+	return code;
+}
+
+
+// order of n keys of width k (lexicographic, then index), keys in [0, range).
+// LSD counting sort, linear in n * k.
+std::vector<int> key_order(const std::vector<int> &key, int k, int range){
+	int n = key.size() / k;
+	std::vector<int> order(n), next(n), count(range + 1);
+	for (int i = 0; i < n; i++) order[i] = i;
+	for (int j = k - 1; j >= 0; j--){
+		std::fill(count.begin(), count.end(), 0);
+		for (int i = 0; i < n; i++) count[key[(size_t)i * k + j] + 1]++;
+		for (int r = 0; r < range; r++) count[r + 1] += count[r];
+		for (int i = 0; i < n; i++) next[count[key[(size_t)order[i] * k + j]]++] = order[i];
+		order.swap(next);
+	}
+	return order;
+}
+
+
+template<int D>
+void morton_reorder(std::vector<double> &vert, std::vector<int> &edge, std::vector<int> &tri,
+					std::vector<int> &vid, std::vector<int> &eid, std::vector<int> &tid){
+	int nv = vert.size() / (D + 1), ne = edge.size() / 2, nt = tri.size() / 3;
+
+	// vertices
+	double lo[D], hi[D], scale[D];
+	for (int d = 0; d < D; d++) lo[d] = hi[d] = nv? vert[d] : 0;
+	for (int i = 0; i < nv; i++)
+		for (int d = 0; d < D; d++){
+			lo[d] = std::min(lo[d], vert[(size_t)i * (D + 1) + d]);
+			hi[d] = std::max(hi[d], vert[(size_t)i * (D + 1) + d]);
+		}
+	double range = (double)((1ULL << (63 / D)) - 1);
+	for (int d = 0; d < D; d++) scale[d] = hi[d] > lo[d]? range / (hi[d] - lo[d]) : 0;
+	std::vector<std::pair<unsigned long long, int> > code(nv);
+	for (int i = 0; i < nv; i++) code[i] = std::make_pair(morton_code<D>(&vert[(size_t)i * (D + 1)], lo, scale), i);
+	std::sort(code.begin(), code.end());
+	vid.resize(nv);
+	for (int i = 0; i < nv; i++) vid[i] = code[i].second;
+	std::vector<std::pair<unsigned long long, int> >().swap(code);
+	std::vector<int> inv(nv);
+	for (int i = 0; i < nv; i++) inv[vid[i]] = i;
+	std::vector<double> v2(vert.size());
+	for (int i = 0; i < nv; i++)
+		std::copy(&vert[(size_t)vid[i] * (D + 1)], &vert[(size_t)vid[i] * (D + 1)] + D + 1,
+				  &v2[(size_t)i * (D + 1)]);
+	vert.swap(v2);
+
+	// edges by (smaller, larger) new vertex id
+	std::vector<int> key(2 * (size_t)ne);
+	for (size_t i = 0; i < edge.size(); i++) edge[i] = inv[edge[i]];
+	for (int i = 0; i < ne; i++){
+		key[2 * (size_t)i] = std::min(edge[2 * (size_t)i], edge[2 * (size_t)i + 1]);
+		key[2 * (size_t)i + 1] = std::max(edge[2 * (size_t)i], edge[2 * (size_t)i + 1]);
+	}
+	eid = key_order(key, 2, nv);
+	std::vector<int> e2(edge.size());
+	for (int i = 0; i < ne; i++){
+		e2[2 * (size_t)i] = edge[2 * (size_t)eid[i]];
+		e2[2 * (size_t)i + 1] = edge[2 * (size_t)eid[i] + 1];
+	}
+	edge.swap(e2);
+
+	// triangles by their sorted new vertex ids
+	key.assign(3 * (size_t)nt, 0);
+	for (size_t i = 0; i < tri.size(); i++) tri[i] = inv[tri[i]];
+	for (int i = 0; i < nt; i++){
+		std::copy(&tri[3 * (size_t)i], &tri[3 * (size_t)i] + 3, &key[3 * (size_t)i]);
+		std::sort(&key[3 * (size_t)i], &key[3 * (size_t)i] + 3);
+	}
+	tid = key_order(key, 3, nv);
+	std::vector<int> t2(tri.size());
+	for (int i = 0; i < nt; i++)
+		std::copy(&tri[3 * (size_t)tid[i]], &tri[3 * (size_t)tid[i]] + 3, &t2[3 * (size_t)i]);
+	tri.swap(t2);
+}
+
+#endif
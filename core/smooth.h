@@ -0,0 +1,316 @@
+/*
+Separable smoothing on a dense grid.
+A 3D kernel that is a product of 1D kernels is applied as three 1D passes,
+one per axis. Data is stored with x fastest: index = (z*ny + y)*nx + x.
+
+Tiling:
+	The grid is cut into slabs along its slowest axis. Each slab is copied
+	with a halo of the kernel radius, processed on its own and its interior
+	written to a separate output, so threads never share writable memory.
+	With the direct method every voxel sees the same inputs in the same
+	order as the serial pass, so the result does not depend on the thread
+	count. An FFT pass along the slab axis works on the slab's own lines,
+	so its rounding (not its result) depends on the slab layout.
+
+Methods (per axis, picked by smooth_plan):
+	SMOOTH_DIRECT	2r+1 multiply-adds per voxel
+	SMOOTH_FFT		lines padded to a power of two P >= n+2r and convolved
+					in the frequency domain, O(P log P) per line. Agrees with
+					the direct method up to rounding (about 1e-12 relative).
+	smooth_plan compares the two costs per voxel, counted in multiply-adds
+	of the row-wise direct pass (y/z). The x pass runs per line and costs
+	SMOOTH_X_COST per tap; one FFT butterfly costs SMOOTH_FFT_COST.
+	Measured crossover on 256^2x64 grids: radius ~32 along x, ~64 along y.
+
+Boundary:
+	SMOOTH_ZERO		values outside the grid are 0
+	SMOOTH_REFLECT	mirror at the border (d c b a | a b c d | d c b a),
+					same as scipy.ndimage mode 'reflect'
+*/
+
+#ifndef SMOOTH_H
+#define SMOOTH_H
+
+#include<vector>
+#include<cmath>
+#include<algorithm>
+#include<thread>
+#include<atomic>
+#include<complex>
+
+#define SMOOTH_ZERO 0
+#define SMOOTH_REFLECT 1
+
+#define SMOOTH_DIRECT 0
+#define SMOOTH_FFT 1
+#define SMOOTH_FFT_COST 6.0
+#define SMOOTH_X_COST 2.0
+
+
+// Same weights as scipy.ndimage.gaussian_filter1d: radius = truncate*sigma
+std::vector<double> gaussian_kernel(double sigma, double truncate = 4.0){
+	int r = (int)(truncate * sigma + 0.5);
+	std::vector<double> w(2 * r + 1);
+	double sum = 0;
+	for(int x = -r; x <= r; ++x){
+		w[x + r] = exp(-0.5 * x * x / (sigma * sigma));
+		sum += w[x + r];
+	}
+	for(auto &v : w) v /= sum;
+	return w;
+}
+
+
+inline long smooth_reflect(long i, long n){
+	long period = 2 * n;
+	i %= period;
+	if (i < 0) i += period;
+	return i < n? i : period - 1 - i;
+}
+
+
+// Boundary value at line position i (outside [0, n))
+template<class T>
+inline double smooth_outside(const T *line, long i, long n, long stride, int boundary){
+	if (boundary == SMOOTH_REFLECT) return line[smooth_reflect(i, n) * stride];
+	return 0;
+}
+
+
+// Convolve every line along axis with w (2r+1 taps).
+// The grid is viewed as [outer][n][inner], inner = product of the faster axes.
+// Lines along x are padded one at a time; along y/z whole rows of length inner
+// are combined, so the innermost loops run over contiguous memory.
+template<class T>
+void smooth_axis(std::vector<T> &data, const int dim[3], int axis,
+				 const std::vector<double> &w, int boundary){
+	int r = w.size() / 2;
+	if (r == 0 && w[0] == 1.0) return;
+	long n = dim[axis];
+	long inner = 1, outer = 1;
+	for(int d = 0; d < axis; ++d) inner *= dim[d];
+	for(int d = axis + 1; d < 3; ++d) outer *= dim[d];
+
+	std::vector<double> pad((n + 2 * r) * inner);
+	std::vector<double> out(n * inner);
+	for(long o = 0; o < outer; ++o){
+		T *block = &data[o * n * inner];
+		for(long i = -r; i < n + r; ++i){
+			double *dst = &pad[(i + r) * inner];
+			if (i >= 0 && i < n){
+				const T *src = block + i * inner;
+				for(long x = 0; x < inner; ++x) dst[x] = src[x];
+			}
+			else
+				for(long x = 0; x < inner; ++x)
+					dst[x] = smooth_outside(block + x, i, n, inner, boundary);
+		}
+		std::fill(out.begin(), out.end(), 0.0);
+		for(long i = 0; i < n; ++i){
+			double * __restrict__ acc = &out[i * inner];
+			for(int t = 0; t <= 2 * r; ++t){
+				const double * __restrict__ src = &pad[(i + t) * inner];
+				double wt = w[t];
+				for(long x = 0; x < inner; ++x)
+					acc[x] += wt * src[x];
+			}
+		}
+		for(long x = 0; x < n * inner; ++x) block[x] = out[x];
+	}
+}
+
+
+// Radix-2 FFT of size P, twiddles and bit reversal computed once
+struct SmoothFFT{
+	long P;
+	std::vector<std::complex<double> > tw;
+	std::vector<long> rev;
+
+	void init(long size){
+		P = size;
+		tw.resize(P / 2);
+		for(long k = 0; k < P / 2; ++k)
+			tw[k] = std::polar(1.0, -2 * M_PI * k / P);
+		rev.assign(P, 0);
+		int bits = 0;
+		while ((1L << bits) < P) ++bits;
+		for(long k = 0; k < P; ++k)
+			for(int b = 0; b < bits; ++b)
+				if (k >> b & 1) rev[k] |= 1L << (bits - 1 - b);
+	}
+
+	// unscaled: run(a, true) after run(a, false) multiplies a by P
+	void run(std::complex<double> *a, bool inverse) const{
+		for(long k = 0; k < P; ++k)
+			if (k < rev[k]) std::swap(a[k], a[rev[k]]);
+		for(long len = 2; len <= P; len <<= 1){
+			long half = len / 2, step = P / len;
+			for(long i = 0; i < P; i += len)
+				for(long j = 0; j < half; ++j){
+					std::complex<double> w = inverse? std::conj(tw[j * step]) : tw[j * step];
+					std::complex<double> u = a[i + j], v = a[i + j + half] * w;
+					a[i + j] = u + v;
+					a[i + j + half] = u - v;
+				}
+		}
+	}
+};
+
+
+inline long smooth_fft_size(long n, int r){
+	long P = 1;
+	while (P < n + 2 * r) P <<= 1;
+	return P;
+}
+
+
+// Same result as smooth_axis, computed line by line with FFTs
+template<class T>
+void smooth_axis_fft(std::vector<T> &data, const int dim[3], int axis,
+					 const std::vector<double> &w, int boundary){
+	int r = w.size() / 2;
+	long n = dim[axis];
+	long inner = 1, outer = 1;
+	for(int d = 0; d < axis; ++d) inner *= dim[d];
+	for(int d = axis + 1; d < 3; ++d) outer *= dim[d];
+
+	SmoothFFT fft;
+	fft.init(smooth_fft_size(n, r));
+	long P = fft.P;
+	// kernel reversed around 0, so that out[i] = sum_t w[t] * pad[i + t]
+	std::vector<std::complex<double> > G(P, 0.0);
+	for(int t = 0; t <= 2 * r; ++t) G[(P - t) % P] = w[t];
+	fft.run(G.data(), false);
+	for(auto &g : G) g /= (double)P;
+
+	std::vector<std::complex<double> > a(P);
+	for(long o = 0; o < outer; ++o)
+		for(long x = 0; x < inner; ++x){
+			T *line = &data[o * n * inner + x];
+			for(long i = -r; i < n + r; ++i)
+				a[i + r] = (i >= 0 && i < n)? (double)line[i * inner]
+							: smooth_outside(line, i, n, inner, boundary);
+			std::fill(a.begin() + n + 2 * r, a.end(), 0.0);
+			fft.run(a.data(), false);
+			for(long k = 0; k < P; ++k) a[k] *= G[k];
+			fft.run(a.data(), true);
+			for(long i = 0; i < n; ++i) line[i * inner] = a[i].real();
+		}
+}
+
+
+// Cheaper method per axis for a grid of size dim
+void smooth_plan(const int dim[3], const std::vector<double> w[3], int method[3]){
+	for(int d = 0; d < 3; ++d){
+		int r = w[d].size() / 2;
+		long n = dim[d];
+		long P = smooth_fft_size(n, r);
+		double direct = (2 * r + 1) * (d == 0? SMOOTH_X_COST : 1.0);
+		double fft = (SMOOTH_FFT_COST * P * log2((double)P) + P) / n;
+		method[d] = (r > 0 && fft < direct)? SMOOTH_FFT : SMOOTH_DIRECT;
+	}
+}
+
+
+// Marks every voxel within r[d] (box) of a nonzero voxel
+template<class T>
+void dilate_separable(std::vector<T> &mask, const int dim[3], const int r[3]){
+	for(int axis = 0; axis < 3; ++axis){
+		if (r[axis] == 0) continue;
+		long n = dim[axis];
+		long inner = 1, outer = 1;
+		for(int d = 0; d < axis; ++d) inner *= dim[d];
+		for(int d = axis + 1; d < 3; ++d) outer *= dim[d];
+		std::vector<int> count(n + 1);
+		for(long o = 0; o < outer; ++o)
+			for(long x = 0; x < inner; ++x){
+				T *line = &mask[o * n * inner + x];
+				count[0] = 0;
+				for(long i = 0; i < n; ++i)
+					count[i + 1] = count[i] + (line[i * inner] != 0);
+				for(long i = 0; i < n; ++i){
+					long lo = std::max(0L, i - r[axis]), hi = std::min(n, i + r[axis] + 1);
+					line[i * inner] = count[hi] > count[lo];
+				}
+			}
+	}
+}
+
+
+template<class T>
+void smooth_passes(std::vector<T> &data, const int dim[3],
+				   const std::vector<double> w[3], int boundary, const int method[3]){
+	for(int axis = 0; axis < 3; ++axis){
+		if (method[axis] == SMOOTH_FFT)
+			smooth_axis_fft(data, dim, axis, w[axis], boundary);
+		else
+			smooth_axis(data, dim, axis, w[axis], boundary);
+	}
+}
+
+
+// Runs fn(tile, tile_dim) on slabs with halo planes, nthreads at a time
+template<class T, class Fn>
+void smooth_tiled(std::vector<T> &data, const int dim[3], const int halo[3],
+				  int nthreads, Fn fn){
+	int ta = 2;
+	while (ta > 0 && dim[ta] == 1) --ta;
+	long n = dim[ta], inner = 1;
+	for(int d = 0; d < ta; ++d) inner *= dim[d];
+	int r = halo[ta];
+	// a slab is at least r+1 planes thick, so the halo never reaches past the next slab
+	long ntiles = std::min((long)nthreads * 4, n / (r + 1));
+	if (nthreads <= 1 || ntiles <= 1){
+		fn(data, dim);
+		return;
+	}
+
+	std::vector<T> out(data.size());
+	std::atomic<long> next(0);
+	auto worker = [&](){
+		for(long t = next++; t < ntiles; t = next++){
+			long a = n * t / ntiles, b = n * (t + 1) / ntiles;
+			long lo = std::max(0L, a - r), hi = std::min(n, b + r);
+			int tdim[3] = {dim[0], dim[1], dim[2]};
+			tdim[ta] = hi - lo;
+			std::vector<T> tile(data.begin() + lo * inner, data.begin() + hi * inner);
+			fn(tile, tdim);
+			std::copy(tile.begin() + (a - lo) * inner, tile.begin() + (b - lo) * inner,
+					  out.begin() + a * inner);
+		}
+	};
+	std::vector<std::thread> pool;
+	for(int i = 0; i < nthreads; ++i) pool.push_back(std::thread(worker));
+	for(auto &th : pool) th.join();
+	data.swap(out);
+}
+
+
+// method: per-axis SMOOTH_DIRECT/SMOOTH_FFT, chosen by smooth_plan if null
+template<class T>
+void smooth_separable(std::vector<T> &data, const int dim[3],
+					  const std::vector<double> w[3], int boundary,
+					  int nthreads = 1, const int *method = NULL){
+	int plan[3];
+	if (method == NULL){
+		smooth_plan(dim, w, plan);
+		method = plan;
+	}
+	int r[3];
+	for(int d = 0; d < 3; ++d) r[d] = w[d].size() / 2;
+	smooth_tiled(data, dim, r, nthreads,
+		[&](std::vector<T> &tile, const int *tdim){
+			smooth_passes(tile, tdim, w, boundary, method);
+		});
+}
+
+
+template<class T>
+void dilate_separable(std::vector<T> &mask, const int dim[3], const int r[3], int nthreads){
+	smooth_tiled(mask, dim, r, nthreads,
+		[&](std::vector<T> &tile, const int *tdim){
+			dilate_separable(tile, tdim, r);
+		});
+}
+
+#endif
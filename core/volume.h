@@ -0,0 +1,254 @@
+/*
+Dense volume input for triangulation.
+Builds the simplicial complex directly from a voxel grid: vertex ids are
+kept in a dense grid index, so no point hashing is needed.
+
+Volume file (.vol, binary):
+	[<int32> * 3]		nx ny nz
+	[<int32> * 1]		dtype: 1 uint8, 2 uint16, 4 float32, 8 float64
+	[<double> * 1]		threshold, voxels with value <= threshold are dropped
+	[<double> * 3]		spacing x y z
+	[<int32> * 3]		offset x y z (voxels)
+	[<dtype> * nx*ny*nz]	voxel values, x fastest (numpy [z][y][x] order)
+
+Voxel (i,j,k) becomes a vertex at ((i,j,k) + offset) * spacing.
+Output is identical to Triangulate mode 1 on the equivalent point cloud.
+*/
+
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include<vector>
+#include<string>
+#include<fstream>
+#include<iostream>
+#include<algorithm>
+#include<stdint.h>
+
+#include "cubetri.h"
+
+
+struct VolumeHeader{
+	int dim[3];
+	int dtype;
+	double thd;
+	double spacing[3];
+	int offset[3];
+};
+
+
+class GridComplex{
+	private:
+		VolumeHeader h;
+		std::vector<int> id;		// vertex id of each grid corner, -1 if none
+		int seed_total;				// vertices below this id are input voxels
+
+		long long at(int i, int j, int k){
+			return ((long long)k * (h.dim[1] + 1) + j) * (h.dim[0] + 1) + i;
+		}
+		int add_vertex(int i, int j, int k, double f){
+			int n = vert.size() / 4;
+			vert.push_back((i + h.offset[0]) * h.spacing[0]);
+			vert.push_back((j + h.offset[1]) * h.spacing[1]);
+			vert.push_back((k + h.offset[2]) * h.spacing[2]);
+			vert.push_back(f);
+			id[at(i, j, k)] = n;
+			return n;
+		}
+
+	public:
+		std::vector<double> vert;	// x y z f per vertex
+		std::vector<int> edge;		// 2 vertex ids per edge
+		std::vector<int> tri;		// 3 vertex ids per triangle
+
+		// true if the cube at grid position (i,j,k) is triangulated
+		bool operator()(int i, int j, int k){
+			if (i < 0 || j < 0 || k < 0 || i >= h.dim[0] || j >= h.dim[1] || k >= h.dim[2])
+				return false;
+			int n = id[at(i, j, k)];
+			if (n < 0 || n >= seed_total) return false;
+			int val = vert[4*n+3];
+			return !(val < -1e-6);
+		}
+
+		void init(const VolumeHeader &header){
+			h = header;
+			id.assign((long long)(h.dim[0] + 1) * (h.dim[1] + 1) * (h.dim[2] + 1), -1);
+			vert.clear(); edge.clear(); tri.clear();
+			seed_total = 0;
+		}
+
+		// voxels must be added in (z, y, x) order
+		void add_voxel(int i, int j, int k, double f){
+			add_vertex(i, j, k, f);
+			seed_total++;
+		}
+
+		int vertices(){return vert.size() / 4;}
+		int edges(){return edge.size() / 2;}
+		int triangles(){return tri.size() / 3;}
+
+		void triangulate(int nb);
+		int write_sc(const std::string &filename);
+};
+
+
+void GridComplex::triangulate(int nb){
+	cube_init(nb);
+	for(int k = 0; k < h.dim[2]; ++k){
+		for(int j = 0; j < h.dim[1]; ++j)
+			for(int i = 0; i < h.dim[0]; ++i){
+				if (!(*this)(i, j, k)) continue;
+				// parity on global voxel position, same as the point cloud path
+				int x = i + h.offset[0], y = j + h.offset[1], z = k + h.offset[2];
+				CubeTable &tab = cube_table[cube_type(x, y, z)];
+				int sub[8];
+				for(auto c : tab.corners){
+					int ci = i + cube_offset(c, 0);
+					int cj = j + cube_offset(c, 1);
+					int ck = k + cube_offset(c, 2);
+					sub[c] = id[at(ci, cj, ck)];
+					if (sub[c] < 0) sub[c] = add_vertex(ci, cj, ck, 1e-6);
+				}
+				for(auto &t : tab.triangles){
+					if (!cube_owns(i, j, k, t, *this)) continue;
+					int v[3] = {sub[t.c[0]], sub[t.c[1]], sub[t.c[2]]};
+					std::sort(v, v + 3);
+					tri.insert(tri.end(), v, v + 3);
+				}
+				for(auto &e : tab.edges){
+					if (!cube_owns(i, j, k, e, *this)) continue;
+					int a = sub[e.c[0]], b = sub[e.c[1]];
+					if (a > b) std::swap(a, b);
+					edge.push_back(a); edge.push_back(b);
+				}
+			}
+		if (k % 10 == 0){
+			std::cout << '\r' << k << '/' << h.dim[2];
+			std::cout.flush();
+		}
+	}
+	std::cout << "\n";
+}
+
+
+int GridComplex::write_sc(const std::string &filename){
+	std::ofstream ofs(filename.c_str(), std::ios::binary);
+	int n = vertices();
+	ofs.write((char*) &n, sizeof(int));
+	ofs.write((char*) vert.data(), sizeof(double) * vert.size());
+	n = edges();
+	ofs.write((char*) &n, sizeof(int));
+	ofs.write((char*) edge.data(), sizeof(int) * edge.size());
+	n = triangles();
+	ofs.write((char*) &n, sizeof(int));
+	ofs.write((char*) tri.data(), sizeof(int) * tri.size());
+	ofs.close();
+	return 0;
+}
+
+
+template<class T>
+void volume_read_slice(std::ifstream &ifs, std::vector<double> &slice){
+	std::vector<T> raw(slice.size());
+	ifs.read((char*) raw.data(), sizeof(T) * raw.size());
+	for(size_t n = 0; n < raw.size(); ++n) slice[n] = raw[n];
+}
+
+
+int volume_read_header(std::ifstream &ifs, VolumeHeader &h){
+	ifs.read((char*) h.dim, sizeof(int) * 3);
+	ifs.read((char*) &h.dtype, sizeof(int));
+	ifs.read((char*) &h.thd, sizeof(double));
+	ifs.read((char*) h.spacing, sizeof(double) * 3);
+	ifs.read((char*) h.offset, sizeof(int) * 3);
+	if (h.dtype != 1 && h.dtype != 2 && h.dtype != 4 && h.dtype != 8){
+		std::cout << "Unsupported voxel type " << h.dtype << "\n";
+		return -1;
+	}
+	std::cout << "Reading volume " << h.dim[0] << "x" << h.dim[1] << "x" << h.dim[2]
+			  << ", threshold " << h.thd << "\n";
+	return 0;
+}
+
+
+int volume_read_slice(std::ifstream &ifs, const VolumeHeader &h, std::vector<double> &slice){
+	if (h.dtype == 1) volume_read_slice<uint8_t>(ifs, slice);
+	else if (h.dtype == 2) volume_read_slice<uint16_t>(ifs, slice);
+	else if (h.dtype == 4) volume_read_slice<float>(ifs, slice);
+	else volume_read_slice<double>(ifs, slice);
+	if (!ifs){
+		std::cout << "Volume file is truncated\n";
+		return -1;
+	}
+	return 0;
+}
+
+
+// Reads a .vol file slice by slice, keeping voxels above the threshold
+int load_volume(const std::string &filename, VolumeHeader &h, GridComplex &G){
+	std::ifstream ifs(filename.c_str(), std::ios::binary);
+	if (!ifs.is_open()){
+		std::cout << "Error opening file\n";
+		return -1;
+	}
+	if (volume_read_header(ifs, h) != 0) return -1;
+
+	G.init(h);
+	std::vector<double> slice((size_t)h.dim[0] * h.dim[1]);
+	for(int k = 0; k < h.dim[2]; ++k){
+		if (volume_read_slice(ifs, h, slice) != 0) return -1;
+		for(int j = 0; j < h.dim[1]; ++j)
+			for(int i = 0; i < h.dim[0]; ++i){
+				double f = slice[(size_t)j * h.dim[0] + i];
+				if (f > h.thd) G.add_voxel(i, j, k, f);
+			}
+	}
+	ifs.close();
+	std::cout << "\t" << G.vertices() << " voxels above threshold\n";
+	return 0;
+}
+
+
+// Reads the whole volume, x fastest
+int read_volume(const std::string &filename, VolumeHeader &h, std::vector<double> &data){
+	std::ifstream ifs(filename.c_str(), std::ios::binary);
+	if (!ifs.is_open()){
+		std::cout << "Error opening file\n";
+		return -1;
+	}
+	if (volume_read_header(ifs, h) != 0) return -1;
+	data.resize((size_t)h.dim[0] * h.dim[1] * h.dim[2]);
+	if (volume_read_slice(ifs, h, data) != 0) return -1;
+	ifs.close();
+	return 0;
+}
+
+
+// Writes data as a float64 volume with the geometry of h
+int write_volume(const std::string &filename, const VolumeHeader &h, const std::vector<double> &data){
+	std::ofstream ofs(filename.c_str(), std::ios::binary);
+	int dtype = 8;
+	ofs.write((char*) h.dim, sizeof(int) * 3);
+	ofs.write((char*) &dtype, sizeof(int));
+	ofs.write((char*) &h.thd, sizeof(double));
+	ofs.write((char*) h.spacing, sizeof(double) * 3);
+	ofs.write((char*) h.offset, sizeof(int) * 3);
+	ofs.write((char*) data.data(), sizeof(double) * data.size());
+	ofs.close();
+	return 0;
+}
+
+
+// Keeps voxels of a dense volume above h.thd
+void grid_from_volume(const VolumeHeader &h, const std::vector<double> &data, GridComplex &G){
+	G.init(h);
+	size_t n = 0;
+	for(int k = 0; k < h.dim[2]; ++k)
+		for(int j = 0; j < h.dim[1]; ++j)
+			for(int i = 0; i < h.dim[0]; ++i, ++n)
+				if (data[n] > h.thd) G.add_voxel(i, j, k, data[n]);
+	std::cout << "\t" << G.vertices() << " voxels above threshold\n";
+}
+
+#endif
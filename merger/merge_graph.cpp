@@ -4,9 +4,27 @@ Author: Suyi Wang
 
 Input: merger_config
 Output: Simplicial complex (to be pipelined to DiMorSC)
+
+Blocks are read in parallel into per-block buffers. Interior endpoints
+are keyed by packed integer coordinates and summed in a per-block hash in
+file order. Points outside the block box are diffused with a fixed 3x3x3
+table into a brick grid covering the band around the box, and their cubes
+are triangulated straight from that grid. All blocks are then merged by a
+parallel sort on (coordinate, block) and a run reduction; edges/triangles
+shared between blocks are removed by the same sort-and-unique.
+Output ids follow (z, y, x) order of the vertices; the result does not
+depend on the thread count.
+
+With stream = 1 blocks are merged one at a time along a space-filling curve
+and finished regions are written as soon as no remaining block can touch
+them, so memory is bounded by the block neighbourhood instead of the
+dataset. Same complex, ids in the order regions complete.
+
+usage: merge_graph <config_file> [threads] [stream]
+Stage times and sizes are written to <output filename>_metrics.json.
 */
 
-// g++ merger/merge_graph.cpp core/hash.cpp core/readini.cpp -O3 -std=c++11 -I./extern/boost -I./core -o bin/merge_graph -w 2>error
+// g++ merger/merge_graph.cpp core/readini.cpp -O3 -std=c++11 -pthread -I./core -o bin/merge_graph -w 2>error
 
 /*
 Merger config has the following format:
@@ -36,9 +54,15 @@ merged
 #include<string>
 #include<algorithm>
 #include<cmath>
+#include<atomic>
+#include<unordered_map>
+#include<unordered_set>
 
-#include"hash.h"
+#include"geometry.h"
 #include"readini.h"
+#include"cubetri.h"
+#include"parallel.h"
+#include"metrics.h"
 
 
 using namespace std;
@@ -50,237 +74,183 @@ using namespace std;
 // Do     fill inner part of a cube - 16
 int nb = 12;
 
-int vcount = 0; //for vector vertex
-vector<point> vertex;
-vector<cp> edge;
-vector<tp> triangle;
+int nthreads = 1;
 
-VertexHash vh;
-EdgeHash eh;
-TriangleHash th;
-
-vector<point> graph_vert;
-
-
-int triangle_cube(int i, int j, int k, int AB){
-	if (AB == 0){ // triangles of Type A
-		int TypeAtri[3*16][3] = {{0,0,0}, {1,0,1}, {0,0,1},
-						  {0,0,0}, {1,0,0}, {1,0,1},
-						  {0,0,0}, {0,1,1}, {0,1,0},
-						  {0,0,0}, {0,0,1}, {0,1,1},
-						  {0,0,0}, {1,1,0}, {1,0,0},
-						  {0,0,0}, {0,1,0}, {1,1,0},
-						  {1,0,0}, {1,1,0}, {1,0,1},
-						  {1,0,1}, {1,1,0}, {1,1,1},
-						  {0,1,0}, {0,1,1}, {1,1,0},
-						  {0,1,1}, {1,1,0}, {1,1,1},
-						  {0,0,1}, {0,1,1}, {1,0,1},
-						  {0,1,1}, {1,1,1}, {1,0,1},
-						  {0,0,0}, {0,1,1}, {1,0,1},// fill
-						  {0,0,0}, {1,0,1}, {1,1,0},
-						  {1,1,0}, {1,0,1}, {0,1,1},
-						  {0,0,0}, {1,1,0}, {0,1,1}
-				   };
-		for (int cnt = 0; cnt < nb; cnt++){
-			int sub1, sub2, sub3;
-
-			point p;
-			p.x = i + TypeAtri[cnt*3][0];
-			p.y = j + TypeAtri[cnt*3][1];
-			p.z = k + TypeAtri[cnt*3][2];
-			sub1 = vh.GetIndex(p);
-			if (sub1 < 0){
-				p.v = 1e-6;
-				vh.InsertVertex(p, vcount);
-				sub1 = vcount;
-				vcount++;
-				vertex.push_back(p);
-			}
-			
-			p.x = i + TypeAtri[cnt*3+1][0];
-			p.y = j + TypeAtri[cnt*3+1][1];
-			p.z = k + TypeAtri[cnt*3+1][2];
-			sub2 = vh.GetIndex(p);
-			if (sub2 < 0){
-				p.v = 1e-6;
-				vh.InsertVertex(p, vcount);
-				sub2 = vcount;
-				vcount++;
-				vertex.push_back(p);
-			}
+Metrics metrics("merge_graph");
 
-			p.x = i + TypeAtri[cnt*3+2][0];
-			p.y = j + TypeAtri[cnt*3+2][1];
-			p.z = k + TypeAtri[cnt*3+2][2];
-			sub3 = vh.GetIndex(p);
-			if (sub3 < 0){
-				p.v = 1e-6;
-				vh.InsertVertex(p, vcount);
-				sub3 = vcount;
-				vcount++;
-				vertex.push_back(p);
-			}
-			
-			tp new_triangle;
-			new_triangle.p1 = sub1; new_triangle.p2 = sub2; new_triangle.p3 = sub3;
-			new_triangle.Reorder();
-			if (!th.HasTriangle(new_triangle)){
-				triangle.push_back(new_triangle);
-				th.InsertTriangle(new_triangle);
-			}
 
-			cp new_edge1;
-			new_edge1.p1 = sub1; new_edge1.p2 = sub2;
-			new_edge1.Reorder();
-			cp new_edge2;
-			new_edge2.p1 = sub1; new_edge2.p2 = sub3;
-			new_edge2.Reorder();
-			cp new_edge3;
-			new_edge3.p1 = sub2; new_edge3.p2 = sub3;
-			new_edge3.Reorder();
-
-			//if (DEBUG){printf("\t%d %d %d\n", sub1, sub2, sub3);}
-
-			if (!eh.HasEdge(new_edge1)){
-				edge.push_back(new_edge1);
-				eh.InsertEdge(new_edge1);
-			}
-			if (!eh.HasEdge(new_edge2)){
-				edge.push_back(new_edge2);
-				eh.InsertEdge(new_edge2);
-			}
-			if (!eh.HasEdge(new_edge3)){
-				edge.push_back(new_edge3);
-				eh.InsertEdge(new_edge3);
-			}
+// Coordinates packed into 21 bits each, z most significant
+typedef unsigned long long vkey;
+const int KEY_BIAS = 1 << 20;
+
+inline vkey pack(int x, int y, int z){
+	return ((vkey)(z + KEY_BIAS) << 42) | ((vkey)(y + KEY_BIAS) << 21) | (vkey)(x + KEY_BIAS);
+}
+
+inline void unpack(vkey k, int &x, int &y, int &z){
+	x = (int)(k & 0x1FFFFF) - KEY_BIAS;
+	y = (int)(k >> 21 & 0x1FFFFF) - KEY_BIAS;
+	z = (int)(k >> 42) - KEY_BIAS;
+}
+
+
+// One contribution to a merged vertex
+struct vrec{
+	vkey key;
+	long order;			// position in the block sequence, unique
+	double v;
+};
+
+bool operator<(const vrec &a, const vrec &b){
+	return a.key < b.key || (a.key == b.key && a.order < b.order);
+}
+
+struct ekey{
+	vkey a, b;
+};
+
+bool operator<(const ekey &p, const ekey &q){
+	return p.a < q.a || (p.a == q.a && p.b < q.b);
+}
+
+bool operator==(const ekey &p, const ekey &q){
+	return p.a == q.a && p.b == q.b;
+}
+
+struct tkey{
+	vkey a, b, c;
+};
+
+bool operator<(const tkey &p, const tkey &q){
+	return p.a < q.a || (p.a == q.a && (p.b < q.b || (p.b == q.b && p.c < q.c)));
+}
+
+bool operator==(const tkey &p, const tkey &q){
+	return p.a == q.a && p.b == q.b && p.c == q.c;
+}
+
+
+// Diffused values of one block, kept in 8^3 bricks allocated where points
+// land. Bricks are found through a dense directory over the block, so
+// diffusion and cube triangulation need no hashing.
+const int BRICK_SHIFT = 3;
+const int BRICK = 1 << BRICK_SHIFT;
+const int BRICK_CELLS = BRICK * BRICK * BRICK;
+
+struct BrickGrid{
+	int lo[3], hi[3], nb[3];
+	vector<int> dir;		// brick index, -1 if not allocated
+	vector<double> val;		// BRICK_CELLS per brick, x fastest
+	vector<char> mark;		// 1 if anything was diffused onto the cell
+
+	void init(const int l[3], const int h[3]){
+		for(int d = 0; d < 3; ++d){
+			lo[d] = l[d]; hi[d] = h[d];
+			nb[d] = ((hi[d] - lo[d]) >> BRICK_SHIFT) + 1;
 		}
+		dir.assign((long)nb[0] * nb[1] * nb[2], -1);
+		val.clear(); mark.clear();
 	}
-	else{// triangles of Type B
-		int TypeAtri[3*16][3] = {{0,0,0}, {0,0,1}, {0,1,0},
-							   {0,0,0}, {0,1,0}, {1,0,0},
-							   {0,0,0}, {1,0,0}, {0,0,1},
-							   {0,1,1}, {0,1,0}, {0,0,1},
-							   {0,1,0}, {1,1,0}, {1,0,0},
-							   {0,0,1}, {1,0,0}, {1,0,1},
-							   {0,1,1}, {1,1,1}, {0,0,1},
-							   {0,0,1}, {1,0,1}, {1,1,1},
-							   {1,0,1}, {1,1,1}, {1,0,0},
-							   {1,0,0}, {1,1,0}, {1,1,1},
-							   {0,1,1}, {1,1,1}, {0,1,0},
-							   {0,1,0}, {1,1,1}, {1,1,0},
-							   {0,0,1}, {0,1,0}, {1,0,0},// fill
-							   {0,1,0}, {1,0,0}, {1,1,1},
-							   {0,0,1}, {1,1,1}, {1,0,0},
-							   {0,0,1}, {1,1,1}, {0,1,0}
-							   };
-		for (int cnt = 0; cnt < nb; cnt++){
-			int sub1, sub2, sub3;
-
-			point p;
-			p.x = i + TypeAtri[cnt*3][0];
-			p.y = j + TypeAtri[cnt*3][1];
-			p.z = k + TypeAtri[cnt*3][2];
-			sub1 = vh.GetIndex(p);
-			if (sub1 < 0){
-				p.v = 1e-6;
-				vh.InsertVertex(p, vcount);
-				sub1 = vcount;
-				vcount++;
-				vertex.push_back(p);
-			}
-			
-			p.x = i + TypeAtri[cnt*3+1][0];
-			p.y = j + TypeAtri[cnt*3+1][1];
-			p.z = k + TypeAtri[cnt*3+1][2];
-			sub2 = vh.GetIndex(p);
-			if (sub2 < 0){
-				p.v = 1e-6;
-				vh.InsertVertex(p, vcount);
-				sub2 = vcount;
-				vcount++;
-				vertex.push_back(p);
-			}
 
-			p.x = i + TypeAtri[cnt*3+2][0];
-			p.y = j + TypeAtri[cnt*3+2][1];
-			p.z = k + TypeAtri[cnt*3+2][2];
-			sub3 = vh.GetIndex(p);
-			if (sub3 < 0){
-				p.v = 1e-6;
-				vh.InsertVertex(p, vcount);
-				sub3 = vcount;
-				vcount++;
-				vertex.push_back(p);
-			}
-			
-			tp new_triangle;
-			new_triangle.p1 = sub1; new_triangle.p2 = sub2; new_triangle.p3 = sub3;
-			new_triangle.Reorder();
-			if (!th.HasTriangle(new_triangle)){
-				triangle.push_back(new_triangle);
-				th.InsertTriangle(new_triangle);
-			}
+	bool inside(int x, int y, int z) const{
+		return x >= lo[0] && x <= hi[0] && y >= lo[1] && y <= hi[1] && z >= lo[2] && z <= hi[2];
+	}
+	long brick(int x, int y, int z) const{
+		return ((long)((z - lo[2]) >> BRICK_SHIFT) * nb[1] + ((y - lo[1]) >> BRICK_SHIFT)) * nb[0]
+			   + ((x - lo[0]) >> BRICK_SHIFT);
+	}
+	int offset(int x, int y, int z) const{
+		return ((((z - lo[2]) & (BRICK - 1)) * BRICK + ((y - lo[1]) & (BRICK - 1))) << BRICK_SHIFT)
+			   + ((x - lo[0]) & (BRICK - 1));
+	}
 
-			cp new_edge1;
-			new_edge1.p1 = sub1; new_edge1.p2 = sub2;
-			new_edge1.Reorder();
-			cp new_edge2;
-			new_edge2.p1 = sub1; new_edge2.p2 = sub3;
-			new_edge2.Reorder();
-			cp new_edge3;
-			new_edge3.p1 = sub2; new_edge3.p2 = sub3;
-			new_edge3.Reorder();
-
-			//if (DEBUG){printf("\t%d %d %d\n", sub1, sub2, sub3);}
-
-			if (!eh.HasEdge(new_edge1)){
-				edge.push_back(new_edge1);
-				eh.InsertEdge(new_edge1);
-			}
-			if (!eh.HasEdge(new_edge2)){
-				edge.push_back(new_edge2);
-				eh.InsertEdge(new_edge2);
-			}
-			if (!eh.HasEdge(new_edge3)){
-				edge.push_back(new_edge3);
-				eh.InsertEdge(new_edge3);
+	// cell (x,y,z), allocating its brick
+	long cell(int x, int y, int z){
+		int &b = dir[brick(x, y, z)];
+		if (b < 0){
+			b = val.size() / BRICK_CELLS;
+			val.resize(val.size() + BRICK_CELLS, 0.0);
+			mark.resize(mark.size() + BRICK_CELLS, 0);
+		}
+		return (long)b * BRICK_CELLS + offset(x, y, z);
+	}
+
+	// cube_owns seed test
+	bool operator()(int x, int y, int z) const{
+		if (!inside(x, y, z)) return false;
+		int b = dir[brick(x, y, z)];
+		return b >= 0 && mark[(long)b * BRICK_CELLS + offset(x, y, z)];
+	}
+
+	// fn(x, y, z, value) for every marked cell, bricks in (z, y, x) order
+	template<class Fn>
+	void for_each(Fn fn) const{
+		for(long n = 0; n < dir.size(); ++n){
+			if (dir[n] < 0) continue;
+			int bx = n % nb[0], by = n / nb[0] % nb[1], bz = n / nb[0] / nb[1];
+			long base = (long)dir[n] * BRICK_CELLS;
+			for(int c = 0; c < BRICK_CELLS; ++c){
+				if (!mark[base + c]) continue;
+				fn(lo[0] + (bx << BRICK_SHIFT) + (c & (BRICK - 1)),
+				   lo[1] + (by << BRICK_SHIFT) + (c >> BRICK_SHIFT & (BRICK - 1)),
+				   lo[2] + (bz << BRICK_SHIFT) + (c >> (2 * BRICK_SHIFT)),
+				   val[base + c]);
 			}
 		}
 	}
-	return 0;
-}
+};
+
+
+// Graph of one block after filtering
+struct BlockBuffer{
+	vector<vrec> vert;		// interior endpoints, then diffused values
+	vector<ekey> edge;		// interior edges and edges of diffused cubes
+	vector<tkey> tri;		// triangles of diffused cubes
+	unordered_map<vkey, int> index;		// position of interior endpoints in vert
+	int interior = 0;
+	int diffused = 0;
+	int outside = 0;		// vertices outside the block box given in the config
+
+	void add(vkey key, double v){
+		auto it = index.find(key);
+		if (it == index.end()){
+			index.insert(make_pair(key, (int)vert.size()));
+			vrec r;
+			r.key = key; r.v = v;
+			vert.push_back(r);
+		}else{
+			vert[it->second].v += v;
+		}
+	}
+};
+
+
+vector<point> vertex;
+vector<cp> edge;
+vector<tp> triangle;
 
 
 double norm_const = 1;
-int diffuse(point p){
+double diffuse_w[27];		// norm_const * exp(-d^2 / 2), indexed (k+1)*9 + (j+1)*3 + i+1
+
+void diffuse_init(){
 	double sigma = 1;
-	int sum = 0;
 	for (int i = -1; i <= 1; ++i)
 		for(int j = -1; j <= 1; ++j)
-			for(int k = -1; k <= 1; ++k){
-				point dif_p;
-				
-				dif_p.x = p.x + i;
-				dif_p.y = p.y + j;
-				dif_p.z = p.z + k;
-				dif_p.v = p.v * norm_const * exp(- (i*i + j*j +k*k)/(2* sigma * sigma));
-				dif_p.in_bbox = false;
-				/*if (dif_p.v < 1e-8) {
-					continue;
-				}*/
-				
-				int idx = vh.GetIndex(dif_p);
-				if (idx < 0){
-					dif_p.in_bbox = false;
-					vh.InsertVertex(dif_p, vcount);
-					vertex.push_back(dif_p);
-					vcount++;
-				}else{
-					vertex[idx].v += dif_p.v;
-					vertex[idx].in_bbox = false;
-				}
-	}
-	return sum;
+			for(int k = -1; k <= 1; ++k)
+				diffuse_w[(k + 1) * 9 + (j + 1) * 3 + i + 1] =
+					norm_const * exp(- (i*i + j*j +k*k)/(2* sigma * sigma));
+}
+
+void diffuse(point p, BrickGrid &grid){
+	const double *w = diffuse_w;
+	for(int k = -1; k <= 1; ++k)
+		for(int j = -1; j <= 1; ++j)
+			for(int i = -1; i <= 1; ++i, ++w){
+				long c = grid.cell(p.x + i, p.y + j, p.z + k);
+				grid.val[c] += p.v * *w;
+				grid.mark[c] = 1;
+			}
 }
 
 
@@ -368,37 +338,79 @@ double kernel_init(double sigma){
 }
 
 
-int Triangulate(){
-	int original_total = vertex.size();
-	
-	double THD = 1e-6;
-	int skip_count = 0;
-	for(int v = 0; v < original_total; ++v){
-		int i, j, k, val;
-		
-		if (v%10000==0){
-			cout << '\r';
-			cout << v << '/' << original_total;
-			cout.flush();
-		}
-		
-		i = vertex[v].x; j = vertex[v].y; k = vertex[v].z; val = vertex[v].v;
-		if (vertex[v].in_bbox) {
-			// cout << "skipped something\n";
-			skip_count++;
-			continue;
+// Sorted unique keys, duplicates removed in place
+template<class T>
+void sort_unique(vector<T> &v){
+	parallel_sort(v, [](const T &a, const T &b){return a < b;}, nthreads);
+	v.erase(unique(v.begin(), v.end()), v.end());
+}
+
+
+// Sums contributions per coordinate in order
+void reduce(vector<vrec> &rec){
+	long m = 0;
+	for(long i = 0; i < rec.size(); ){
+		vrec r = rec[i];
+		long j = i + 1;
+		for(; j < rec.size() && rec[j].key == r.key; ++j)
+			r.v += rec[j].v;
+		rec[m++] = r;
+		i = j;
+	}
+	rec.resize(m);
+}
+
+
+void reconcile(vector<BlockBuffer> &blocks, vector<vkey> &keys, vector<double> &val){
+	vector<long> start(blocks.size() + 1, 0);
+	for(int b = 0; b < blocks.size(); ++b)
+		start[b + 1] = start[b] + blocks[b].vert.size();
+	vector<vrec> all(start.back());
+	parallel_for(blocks.size(), nthreads, [&](long a, long e){
+		for(long b = a; b < e; ++b){
+			copy(blocks[b].vert.begin(), blocks[b].vert.end(), all.begin() + start[b]);
+			vector<vrec>().swap(blocks[b].vert);
 		}
+	});
+	printf("\tSorting %ld vertex records\n", (long)all.size());
+	parallel_sort(all, [](const vrec &a, const vrec &b){return a < b;}, nthreads);
+
+	reduce(all);
+	keys.resize(all.size()); val.resize(all.size());
+	for(long i = 0; i < all.size(); ++i){
+		keys[i] = all[i].key;
+		val[i] = all[i].v;
+	}
+}
+
+
+int find_key(const vector<vkey> &keys, vkey k){
+	return lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+}
+
 
-		if ((i+j+k)%2==1){
-			triangle_cube(i, j, k, 0);
+// Triangulates the cubes at the diffused points of one block. Simplices
+// shared by two diffused cubes of the block are emitted once, by the owner
+// (see cubetri.h); duplicates between blocks are removed after the merge.
+void Triangulate(const BrickGrid &grid, BlockBuffer &buf){
+	grid.for_each([&](int i, int j, int k, double){
+		const CubeTable &tab = cube_table[cube_type(i, j, k)];
+		vkey sub[8];
+		for(auto c : tab.corners)
+			sub[c] = pack(i + cube_offset(c, 0), j + cube_offset(c, 1), k + cube_offset(c, 2));
+		for(auto &s : tab.triangles){
+			if (!cube_owns(i, j, k, s, grid)) continue;
+			vkey p[3] = {sub[s.c[0]], sub[s.c[1]], sub[s.c[2]]};
+			sort(p, p + 3);
+			buf.tri.push_back(tkey{p[0], p[1], p[2]});
 		}
-		else{
-			triangle_cube(i, j, k, 1);
+		for(auto &s : tab.edges){
+			if (!cube_owns(i, j, k, s, grid)) continue;
+			vkey p = sub[s.c[0]], q = sub[s.c[1]];
+			if (p > q) swap(p, q);
+			buf.edge.push_back(ekey{p, q});
 		}
-	}
-	
-	printf("\tSkipped %d points\n", skip_count);
-	return 0;
+	});
 }
 
 // For MinGW only
@@ -421,6 +433,8 @@ struct fileinfo{
 	// 2 pairs of 3D coordinate defines the bounding box
 	// offset: xmin ymin zmin xmax ymax zmax
 	int offset[6];
+	// after adjust_bbox: box including the overlap, xmin xmax ymin ymax zmin zmax
+	int bound[6];
 };
 
 ostream& operator<<(ostream& os, const parameter& p)  
@@ -475,6 +489,7 @@ int adjust_bbox(vector<fileinfo> &blocks, parameter para){
 		swap(blocks[i].offset[1], blocks[i].offset[3]);
 		swap(blocks[i].offset[2], blocks[i].offset[4]);
 		swap(blocks[i].offset[2], blocks[i].offset[3]);
+		copy(blocks[i].offset, blocks[i].offset + 6, blocks[i].bound);
 		for(int j = 0; j < overlapdim; ++j){
 			// shrink axis-min
 			blocks[i].offset[j*2] += para.overlap[j];
@@ -486,7 +501,7 @@ int adjust_bbox(vector<fileinfo> &blocks, parameter para){
 }
 
 
-void ProcessGraph(fileinfo blk){
+void ProcessGraph(fileinfo blk, BlockBuffer &buf){
 	string vert_name = blk.name + "_vert.txt";
 	string edge_name = blk.name + "_edge.txt";
 	
@@ -497,7 +512,7 @@ void ProcessGraph(fileinfo blk){
 	}
 	
 	int nl;
-	graph_vert.clear();
+	vector<point> graph_vert;
 	bool first = 1;
 	vector<double> vertexbound(6, 0);
 	
@@ -508,81 +523,466 @@ void ProcessGraph(fileinfo blk){
 		sscanf(input_str.c_str(), 
 			   "%d%d%d%lf",
 			   &p.x, &p.y, &p.z, &p.v);
-		//cout << input_str << endl;
-		//cout << vector<int>({p.x, p.y, p.z, p.v}) << endl;
 		graph_vert.push_back(p);  // + 1 or not
 		update_bbox(vertexbound, first, p);
 		getline(fp, input_str);
 	}
 	fp.close();
-	printf("\tRead %d vertices\n \tbounded in:", graph_vert.size());
-	for(int i =0; i< 6; i++) printf(" %.0f ", vertexbound[i]);
-	printf("\n");
+	vector<int> outer(blk.bound, blk.bound + 6);
+	for(auto &p : graph_vert)
+		if (!in_range(p, outer)) buf.outside++;
+	if (DEBUG){
+		printf("\tRead %d vertices\n \tbounded in:", (int)graph_vert.size());
+		for(int i =0; i< 6; i++) printf(" %.0f ", vertexbound[i]);
+		printf("\n");
+	}
 	
 	
 	fp.open(edge_name.c_str(), ios::in);
 	int e1, e2;
-	int counter = 0;
-	int c_interior = 0;
 	double persist;
 
 	vector<int> bbox(blk.offset, blk.offset+ 6);
+	// diffused points are outside bbox, so only the band around it gets bricks
+	int glo[3], ghi[3];
+	for(int d = 0; d < 3; ++d){
+		glo[d] = (int)vertexbound[2 * d] - 1;
+		ghi[d] = (int)vertexbound[2 * d + 1] + 1;
+	}
+	BrickGrid grid;
+	grid.init(glo, ghi);
 	getline(fp, input_str);
 	while(!fp.eof()){
 		sscanf(input_str.c_str(), "%d%d%d%lf", &e1, &e2, &nl,&persist);
 		e1--;e2--;
 		if (in_range(graph_vert[e1], bbox) && in_range(graph_vert[e2], bbox)){
-			// only insert a point.
-			int idx = vh.GetIndex(graph_vert[e1]);
-			int idx1 = -1, idx2 = -1;
-			if (idx < 0){
-				graph_vert[e1].in_bbox = true;
-				vh.InsertVertex(graph_vert[e1], vcount);
-				vertex.push_back(graph_vert[e1]);
-				idx1 = vcount;
-				vcount++;
-			}else{
-				vertex[idx].v += graph_vert[e1].v;
-				idx1 = idx;
-			}
-			
-			idx = vh.GetIndex(graph_vert[e2]);
-			if (idx < 0){
-				graph_vert[e2].in_bbox = true;
-				vh.InsertVertex(graph_vert[e2], vcount);
-				vertex.push_back(graph_vert[e2]);
-				idx2 = vcount;
-				vcount++;
-			}else{
-				vertex[idx].v += graph_vert[e2].v;
-				idx2 = idx;
-			}
-
-			cp new_edge;
-			new_edge.p1 = idx1; new_edge.p2 = idx2;
-			new_edge.Reorder();
-			if (!eh.HasEdge(new_edge)){
-				edge.push_back(new_edge);
-				eh.InsertEdge(new_edge);
-			}
-			c_interior++;
+			point &p1 = graph_vert[e1], &p2 = graph_vert[e2];
+			ekey e{pack(p1.x, p1.y, p1.z), pack(p2.x, p2.y, p2.z)};
+			buf.add(e.a, p1.v);
+			buf.add(e.b, p2.v);
+			if (e.b < e.a) swap(e.a, e.b);
+			buf.edge.push_back(e);
+			buf.interior++;
 		}	
 		else{
 			if (!in_range(graph_vert[e1], bbox)){
-				diffuse(graph_vert[e1]);
-				counter ++;
+				diffuse(graph_vert[e1], grid);
+				buf.diffused ++;
 			}
 			if (!in_range(graph_vert[e2], bbox)){
-				diffuse(graph_vert[e2]);
-				counter ++;
+				diffuse(graph_vert[e2], grid);
+				buf.diffused ++;
 			}
 		}
 		getline(fp, input_str);
 	}
-	
-	printf("\tprocessed %d interior edges, %d diffused points\n", c_interior, counter, vh.size());
 	fp.close();
-	printf("\tdone\n");
+	unordered_map<vkey, int>().swap(buf.index);
+
+	grid.for_each([&](int x, int y, int z, double v){
+		vrec r;
+		r.key = pack(x, y, z); r.v = v;
+		buf.vert.push_back(r);
+	});
+	Triangulate(grid, buf);
+}
+
+
+// Streaming merge
+//
+// A block influences vertices within its box (overlap included) plus 2:
+// one for diffusion and one for the far corners of triangulated cubes.
+// Once every block whose reach intersects the reach of block b has been
+// merged, no vertex inside b's reach can change any more: it gets its final
+// id and is written out. Edges and triangles follow as soon as all their
+// vertices are written. Blocks are merged along a Morton curve so that
+// reaches complete soon after they are opened, and only the vertices and
+// simplices of open reaches are kept in memory.
+
+struct Box{
+	int lo[3], hi[3];
+
+	bool intersects(const Box &o) const{
+		for(int d = 0; d < 3; ++d)
+			if (hi[d] < o.lo[d] || o.hi[d] < lo[d]) return false;
+		return true;
+	}
+	bool contains(vkey key) const{
+		int x[3];
+		unpack(key, x[0], x[1], x[2]);
+		for(int d = 0; d < 3; ++d)
+			if (x[d] < lo[d] || x[d] > hi[d]) return false;
+		return true;
+	}
+};
+
+
+// Uniform bucket grid over block boxes, cell size = mean box extent
+struct BlockIndex{
+	int lo[3], cell[3], n[3];
+	vector<Box> box;
+	vector<vector<int> > bucket;
+
+	int cell_of(int x, int d) const{
+		return min(n[d] - 1, max(0, (x - lo[d]) / cell[d]));
+	}
+
+	void build(const vector<Box> &boxes){
+		box = boxes;
+		int hi[3];
+		for(int d = 0; d < 3; ++d){
+			lo[d] = box[0].lo[d]; hi[d] = box[0].hi[d];
+			long ext = 0;
+			for(auto &b : box){
+				lo[d] = min(lo[d], b.lo[d]);
+				hi[d] = max(hi[d], b.hi[d]);
+				ext += b.hi[d] - b.lo[d] + 1;
+			}
+			cell[d] = max(1L, ext / (long)box.size());
+			n[d] = (hi[d] - lo[d]) / cell[d] + 1;
+		}
+		bucket.assign((long)n[0] * n[1] * n[2], vector<int>());
+		for(int i = 0; i < box.size(); ++i)
+			for(int z = cell_of(box[i].lo[2], 2); z <= cell_of(box[i].hi[2], 2); ++z)
+				for(int y = cell_of(box[i].lo[1], 1); y <= cell_of(box[i].hi[1], 1); ++y)
+					for(int x = cell_of(box[i].lo[0], 0); x <= cell_of(box[i].hi[0], 0); ++x)
+						bucket[((long)z * n[1] + y) * n[0] + x].push_back(i);
+	}
+
+	// blocks whose box intersects q, ascending
+	void query(const Box &q, vector<int> &out) const{
+		out.clear();
+		for(int z = cell_of(q.lo[2], 2); z <= cell_of(q.hi[2], 2); ++z)
+			for(int y = cell_of(q.lo[1], 1); y <= cell_of(q.hi[1], 1); ++y)
+				for(int x = cell_of(q.lo[0], 0); x <= cell_of(q.hi[0], 0); ++x)
+					for(int i : bucket[((long)z * n[1] + y) * n[0] + x])
+						if (box[i].intersects(q)) out.push_back(i);
+		sort(out.begin(), out.end());
+		out.erase(unique(out.begin(), out.end()), out.end());
+	}
+
+	// Morton code of the box centre in cell units
+	unsigned long long morton(int i) const{
+		unsigned long long code = 0;
+		int c[3];
+		for(int d = 0; d < 3; ++d)
+			c[d] = ((box[i].lo[d] + box[i].hi[d]) / 2 - lo[d]) / cell[d];
+		for(int bit = 20; bit >= 0; --bit)
+			for(int d = 2; d >= 0; --d)
+				code = code << 1 | (c[d] >> bit & 1);
+		return code;
+	}
+};
+
+
+struct ekey_hash{
+	size_t operator()(const ekey &e) const{
+		return hash<vkey>()(e.a * 0x9E3779B97F4A7C15ULL ^ e.b);
+	}
+};
+
+struct tkey_hash{
+	size_t operator()(const tkey &t) const{
+		return hash<vkey>()((t.a * 0x9E3779B97F4A7C15ULL ^ t.b) * 0x9E3779B97F4A7C15ULL ^ t.c);
+	}
+};
+
+
+// .sc output written as simplices arrive. Edges and triangles wait in
+// temporary files until the vertex count is known.
+struct ScStream{
+	string name;
+	ofstream ofs, efs, tfs;
+	int nv = 0, ne = 0, nt = 0;
+
+	int open(const string &fname){
+		name = fname;
+		ofs.open(name.c_str(), ios::binary);
+		efs.open((name + ".edge.tmp").c_str(), ios::binary);
+		tfs.open((name + ".tri.tmp").c_str(), ios::binary);
+		if (!ofs || !efs || !tfs){
+			cout << "Cannot write " << name << endl;
+			return -1;
+		}
+		ofs.write((char*) &nv, sizeof(int));
+		return 0;
+	}
+	int vertex(vkey key, double v){
+		int x, y, z;
+		unpack(key, x, y, z);
+		double buf[4] = {(double)x, (double)y, (double)z, v};
+		ofs.write((char*) buf, sizeof(buf));
+		return nv++;
+	}
+	void edge(int a, int b){
+		int buf[2] = {a, b};
+		efs.write((char*) buf, sizeof(buf));
+		ne++;
+	}
+	void triangle(int a, int b, int c){
+		int buf[3] = {a, b, c};
+		tfs.write((char*) buf, sizeof(buf));
+		nt++;
+	}
+	void append(const string &tmp, int count){
+		ofs.write((char*) &count, sizeof(int));
+		ifstream ifs(tmp.c_str(), ios::binary);
+		if (count > 0) ofs << ifs.rdbuf();
+		ifs.close();
+		remove(tmp.c_str());
+	}
+	void close(){
+		efs.close(); tfs.close();
+		append(name + ".edge.tmp", ne);
+		append(name + ".tri.tmp", nt);
+		ofs.seekp(0);
+		ofs.write((char*) &nv, sizeof(int));
+		ofs.close();
+	}
+};
+
+
+struct StreamVertex{
+	double v = 0;
+	bool data = false;		// false: cube corner only, written with 1e-6
+};
+
+struct StreamMerge{
+	unordered_map<vkey, StreamVertex> open;		// vertices of open reaches
+	unordered_map<vkey, int> done;				// written, still used by a pending simplex
+	unordered_set<ekey, ekey_hash> edges;
+	unordered_set<tkey, tkey_hash> tris;
+	ScStream out;
+	long peak_vert = 0, peak_simplex = 0;
+
+	void add(const BlockBuffer &buf){
+		for(auto &r : buf.vert){
+			StreamVertex &s = open[r.key];
+			s.v += r.v;
+			s.data = true;
+		}
+		for(auto &t : buf.tri){
+			open[t.a]; open[t.b]; open[t.c];
+			tris.insert(t);
+		}
+		edges.insert(buf.edge.begin(), buf.edge.end());
+		peak_vert = max(peak_vert, (long)(open.size() + done.size()));
+		peak_simplex = max(peak_simplex, (long)(edges.size() + tris.size()));
+	}
+
+	int id(vkey k){
+		auto it = done.find(k);
+		return it == done.end()? -1 : it->second;
+	}
+
+	// Writes everything that only depends on vertices inside reach
+	void flush(const Box &reach){
+		vector<vkey> ready;
+		for(auto &kv : open)
+			if (reach.contains(kv.first)) ready.push_back(kv.first);
+		if (ready.empty()) return;
+		sort(ready.begin(), ready.end());
+		for(vkey k : ready){
+			const StreamVertex &s = open[k];
+			done[k] = out.vertex(k, s.data? s.v : 1e-6);
+			open.erase(k);
+		}
+
+		vector<cp> e;
+		for(auto it = edges.begin(); it != edges.end(); ){
+			cp c{id(it->a), id(it->b)};
+			if (c.p1 < 0 || c.p2 < 0){
+				++it;
+				continue;
+			}
+			c.Reorder();
+			e.push_back(c);
+			it = edges.erase(it);
+		}
+		sort(e.begin(), e.end(), [](const cp &p, const cp &q){
+			return p.p1 < q.p1 || (p.p1 == q.p1 && p.p2 < q.p2);
+		});
+		for(auto &c : e) out.edge(c.p1, c.p2);
+
+		vector<tp> t;
+		for(auto it = tris.begin(); it != tris.end(); ){
+			tp c{id(it->a), id(it->b), id(it->c)};
+			if (c.p1 < 0 || c.p2 < 0 || c.p3 < 0){
+				++it;
+				continue;
+			}
+			c.Reorder();
+			t.push_back(c);
+			it = tris.erase(it);
+		}
+		sort(t.begin(), t.end(), [](const tp &p, const tp &q){
+			return p.p1 < q.p1 || (p.p1 == q.p1 && (p.p2 < q.p2 || (p.p2 == q.p2 && p.p3 < q.p3)));
+		});
+		for(auto &c : t) out.triangle(c.p1, c.p2, c.p3);
+
+		// written vertices are only kept while a pending simplex uses them
+		unordered_set<vkey> used;
+		for(auto &s : edges){used.insert(s.a); used.insert(s.b);}
+		for(auto &s : tris){used.insert(s.a); used.insert(s.b); used.insert(s.c);}
+		for(auto it = done.begin(); it != done.end(); )
+			it = used.count(it->first)? ++it : done.erase(it);
+	}
+};
+
+
+int merge_stream(vector<fileinfo> &blocks, const string &outname){
+	if (blocks.empty()) return 0;
+	vector<Box> reach(blocks.size());
+	for(int i = 0; i < blocks.size(); ++i)
+		for(int d = 0; d < 3; ++d){
+			reach[i].lo[d] = blocks[i].bound[2 * d] - 2;
+			reach[i].hi[d] = blocks[i].bound[2 * d + 1] + 2;
+		}
+	BlockIndex index;
+	index.build(reach);
+	printf("Block index: %d x %d x %d cells of %d x %d x %d\n",
+		   index.n[0], index.n[1], index.n[2], index.cell[0], index.cell[1], index.cell[2]);
+
+	vector<int> order(blocks.size());
+	vector<unsigned long long> code(blocks.size());
+	for(int i = 0; i < blocks.size(); ++i){
+		order[i] = i;
+		code[i] = index.morton(i);
+	}
+	stable_sort(order.begin(), order.end(), [&](int a, int b){return code[a] < code[b];});
+
+	// a reach is complete when all blocks intersecting it are merged
+	vector<vector<int> > neighbour(blocks.size());
+	vector<int> remaining(blocks.size());
+	for(int i = 0; i < blocks.size(); ++i){
+		index.query(reach[i], neighbour[i]);
+		remaining[i] = neighbour[i].size();
+	}
+
+	StreamMerge M;
+	if (M.out.open(outname) != 0) return -1;
+	Stage st(metrics, "stream_merge");
+	int outside = 0;
+	// read nthreads blocks at a time, merge them in curve order
+	for(int w = 0; w < order.size(); w += nthreads){
+		int wn = min((int)order.size() - w, nthreads);
+		vector<BlockBuffer> buffers(wn);
+		parallel_for(wn, nthreads, [&](long a, long b){
+			for(long t = a; t < b; ++t)
+				ProcessGraph(blocks[order[w + t]], buffers[t]);
+		});
+		for(int t = 0; t < wn; ++t){
+			int i = order[w + t];
+			printf("Graph %s: %d interior edges, %d diffused points\n",
+				   blocks[i].name.c_str(), buffers[t].interior, buffers[t].diffused);
+			outside += buffers[t].outside;
+			M.add(buffers[t]);
+			buffers[t] = BlockBuffer();
+			for(int j : neighbour[i])
+				if (--remaining[j] == 0) M.flush(reach[j]);
+		}
+	}
+	if (outside > 0)
+		printf("Warning: %d vertices outside their block box, the streamed merge may differ\n", outside);
+	if (!M.open.empty() || !M.edges.empty() || !M.tris.empty())
+		printf("Warning: %d vertices, %d edges, %d triangles left unwritten\n",
+			   (int)M.open.size(), (int)M.edges.size(), (int)M.tris.size());
+	M.out.close();
+	st.stop();
+	printf("\t%d vertices, %d edges, %d triangles\n", M.out.nv, M.out.ne, M.out.nt);
+	printf("\tPeak in memory: %ld vertices, %ld edges and triangles\n", M.peak_vert, M.peak_simplex);
+	metrics.count("vertices", M.out.nv);
+	metrics.count("edges", M.out.ne);
+	metrics.count("triangles", M.out.nt);
+	metrics.count("peak_vertices", M.peak_vert);
+	metrics.count("peak_simplices", M.peak_simplex);
+	return 0;
+}
+
+
+// Whole dataset in memory, ids in (z, y, x) order
+int merge_memory(vector<fileinfo> &blocks, const string &outname){
+	// Read and filter blocks
+	Stage read(metrics, "read_blocks");
+	vector<BlockBuffer> buffers(blocks.size());
+	atomic<int> next(0);
+	parallel_for(nthreads, nthreads, [&](long, long){
+		for(int i = next++; i < blocks.size(); i = next++){
+			ProcessGraph(blocks[i], buffers[i]);
+		}
+	});
+	long order = 0;
+	for(int i = 0; i < blocks.size(); i++){
+		printf("Graph %s: %d interior edges, %d diffused points\n",
+			   blocks[i].name.c_str(), buffers[i].interior, buffers[i].diffused);
+		for(auto &r : buffers[i].vert) r.order = order++;
+	}
+	read.stop();
+
+	// Merge vertices
+	Stage merge(metrics, "merge");
+	vector<vkey> keys;
+	vector<double> val;
+	reconcile(buffers, keys, val);
+	printf("\t%d vertices after merge\n", (int)keys.size());
+
+	// Cubes of diffused points were triangulated per block; add missing corners
+	vector<ekey> edges;
+	vector<tkey> tri;
+	for(auto &b : buffers){
+		edges.insert(edges.end(), b.edge.begin(), b.edge.end());
+		tri.insert(tri.end(), b.tri.begin(), b.tri.end());
+		vector<ekey>().swap(b.edge);
+		vector<tkey>().swap(b.tri);
+	}
+	sort_unique(tri);
+	sort_unique(edges);
+	vector<vkey> corner;
+	for(auto &t : tri){
+		corner.push_back(t.a); corner.push_back(t.b); corner.push_back(t.c);
+	}
+	sort_unique(corner);
+	vector<vkey> merged;
+	merged.reserve(keys.size() + corner.size());
+	set_union(keys.begin(), keys.end(), corner.begin(), corner.end(), back_inserter(merged));
+	vector<vkey>().swap(corner);
+	printf("\t%d vertices, %d edges, %d triangles\n",
+		   (int)merged.size(), (int)edges.size(), (int)tri.size());
+
+	metrics.count("vertices", merged.size());
+	metrics.count("edges", edges.size());
+	metrics.count("triangles", tri.size());
+
+	// Final ids
+	vertex.resize(merged.size());
+	parallel_for(merged.size(), nthreads, [&](long a, long b){
+		for(long n = a; n < b; ++n){
+			point &p = vertex[n];
+			unpack(merged[n], p.x, p.y, p.z);
+			long m = find_key(keys, merged[n]);
+			p.v = (m < keys.size() && keys[m] == merged[n])? val[m] : 1e-6;
+		}
+	});
+	edge.resize(edges.size());
+	parallel_for(edges.size(), nthreads, [&](long a, long b){
+		for(long n = a; n < b; ++n){
+			edge[n].p1 = find_key(merged, edges[n].a);
+			edge[n].p2 = find_key(merged, edges[n].b);
+		}
+	});
+	triangle.resize(tri.size());
+	parallel_for(tri.size(), nthreads, [&](long a, long b){
+		for(long n = a; n < b; ++n){
+			triangle[n].p1 = find_key(merged, tri[n].a);
+			triangle[n].p2 = find_key(merged, tri[n].b);
+			triangle[n].p3 = find_key(merged, tri[n].c);
+		}
+	});
+	merge.stop();
+	
+	Stage write(metrics, "write");
+	simplex_output(outname);
+	return 0;
 }
 
 
@@ -592,21 +992,11 @@ int main(int argc, char* argv[])
 	// format: s_#_vert.txt
 	// merge_graph_exe <prefix> <trans_matrix> <max_file_num>
 	string search_path;
-	string setting_name;
-	string trans;
-	bool degreed;
-	vector<double> bboundary;
-	vector<int> filelist;
 
 	parameter para;
 	vector<fileinfo> blocks;
-	if (argc == 2){
-		/*
-		prefix = string(argv[1]);
-		trans = string(argv[2]);
-		setting_name = string(argv[3]);
-		nb = 12;
-		*/
+	int stream = 0;
+	if (argc >= 2 && argc <= 4){
 		string configname(argv[1]);
 		cout << "Reading parameters from: " << configname << endl;
 		init_file(configname, para, blocks);
@@ -615,32 +1005,32 @@ int main(int argc, char* argv[])
 
 		search_path = getpath(argv[1]);
 		cout << "work folder: " << search_path << endl;
+		if (argc >= 3) nthreads = atoi(argv[2]);
+		if (argc >= 4) stream = atoi(argv[3]);
+		if (nthreads <= 0) nthreads = thread::hardware_concurrency();
+		cout << "threads: " << nthreads << (stream? ", streaming" : "") << endl;
 	}
 	else {
-		cout << "usage: merge_graph <config_file>";
+		cout << "usage: merge_graph <config_file> [threads] [stream]";
 		return 0;
 	}
 
 	// adjust bounding box for each block according to overlap
 	adjust_bbox(blocks, para);
 
-	vertex.clear(); edge.clear(); triangle.clear();
 	norm_const = kernel_init(0.5);
 	cout << "Normalize factor: " << norm_const << endl;
+	diffuse_init();
+	cube_init(nb);
 	
-	for(int i = 0; i < blocks.size(); i++){
-		string filename = search_path + blocks[i].name;
-		blocks[i].name = filename;
-		printf("Processing Graph %s...\n", filename.c_str());
-		cout << "\t" << vector<int>(blocks[i].offset, blocks[i].offset+ 6) << endl;
-		
-		ProcessGraph(blocks[i]);
-	}
-	
-	Triangulate();
-	
-	simplex_output(search_path+para.out_prefix);
+	for(auto &b : blocks) b.name = search_path + b.name;
+	if (stream)
+		merge_stream(blocks, search_path + para.out_prefix + ".sc");
+	else
+		merge_memory(blocks, search_path + para.out_prefix);
 
+	metrics.count("blocks", blocks.size());
+	metrics.write(search_path + para.out_prefix + "_metrics.json");
 	printf("Done\n");
 	
 	return 0;
@@ -0,0 +1,246 @@
+/*
+Runs the DiMorSC pipeline in one process:
+	preprocess -> triangulation -> DiMorSC -> to_tree
+Same stages and JSON configuration as py_helper/backend/DiMorSC.py,
+but the volume, the simplicial complex and the skeleton are handed over in
+memory instead of through .dens/.sc/_vert.txt/_edge.txt/.ini files.
+
+
+Execute command:
+	./dimorsc_pipeline <volume.vol> <config.json> [workpath]
+
+	volume.vol	dense volume, see core/volume.h
+	config.json	same format as data/DiMorSC.json
+	workpath	output folder, default output/
+	Outputs are written to <workpath>/<volume name>_*
+
+
+Actions:
+	preprocess		"sigma", "threshold", "threads" (default 1, 0 for all cores),
+					"truncate" (kernel radius in sigmas, default 4)
+					Gaussian smoothing (scipy.ndimage.gaussian_filter,
+					mode 'reflect'), computed in double precision. Large kernels
+					switch to FFT convolution, see core/smooth.h.
+					Without this action the volume is used as is, with the
+					threshold stored in its header.
+	triangulation	"fill" (0: 12 triangles per cube, 1: 16)
+	DiMorSC			"threshold" (persistence), "threads" (default 1, 0 for all
+					cores; complex, pseudo-Morse function and filtration),
+					"reorder" (renumber the complex along a Morton curve)
+	to_tree			"root" (one or more "x y z"), "saddle", "component",
+					same as graph2tree, and "threads" (default 1, 0 for all cores)
+
+Every action takes "log": if true, its intermediate file is written as the
+python pipeline would (.vol, .sc, _vert.txt/_edge.txt/.ini + presave/.snap).
+Tree outputs of to_tree are always written.
+Stage times, peak memory and sizes are written to <workpath>/<volume name>_metrics.json.
+*/
+
+#define DEBUG 0
+
+#define EPS_compare 1e-8
+
+#include <ctime>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+using namespace std;
+
+#include "Simplex.h"
+#include "persistence.h"
+#include "DiscreteVField.h"
+#include "Simplicial2Complex.h"
+#include "smooth.h"
+#include "volume.h"
+#include "graph.h"
+#include "metrics.h"
+
+namespace pt = boost::property_tree;
+
+
+string rmvExt(const string &filename){
+	return filename.substr(0, filename.find_last_of("."));
+}
+
+string basename(const string &filename){
+	size_t pos = filename.find_last_of("/");
+	return pos == string::npos? filename : filename.substr(pos + 1);
+}
+
+bool json_flag(const pt::ptree &para, const string &key){
+	string v = para.get<string>(key, "false");
+	return v == "true" || v == "1";
+}
+
+
+int main(int argc, char* argv[]){
+	if (argc < 3){
+		cout << "Usage: ./dimorsc_pipeline <volume.vol> <config.json> [workpath]" << endl;
+		return 1;
+	}
+	string input = argv[1];
+	string workpath = argc >= 4? argv[3] : "output/";
+	if (workpath[workpath.size() - 1] != '/') workpath += '/';
+	mkdir(workpath.c_str(), 0755);
+	string prefix = workpath + rmvExt(basename(input));
+
+	pt::ptree config;
+	try{
+		pt::read_json(argv[2], config);
+	}catch(pt::json_parser_error &e){
+		cout << "Error reading " << argv[2] << ": " << e.what() << endl;
+		return 1;
+	}
+
+	VolumeHeader h;
+	GridComplex G;
+	bool gridready = false;		// G holds the voxels above threshold
+	bool triangulated = false;
+	Simplicial2Complex<3> K;		// the pipeline works on 3D volumes
+	Skeleton sk;
+	bool skeletonready = false;
+	Metrics M("dimorsc_pipeline");
+
+	// a missing key or wrong value type in the json ends the run
+	try{
+		for(auto &item : config.get_child("data")){
+			const pt::ptree &para = item.second;
+			string action = para.get<string>("action", "");
+			bool log = json_flag(para, "log");
+
+			if (action == "preprocess"){
+				double sigma = para.get<double>("sigma");
+				double thd = para.get<double>("threshold");
+				int threads = para.get<int>("threads", 1);
+				if (threads <= 0) threads = thread::hardware_concurrency();
+				cout << "[DiMorSC]\tSmoothing: sigma " << sigma << ", threshold " << thd << endl;
+				Stage st(M, "preprocess");
+				vector<double> vol;
+				if (read_volume(input, h, vol) != 0) return 1;
+				double truncate = para.get<double>("truncate", 4.0);
+				vector<double> w[3];
+				for(int d = 0; d < 3; ++d) w[d] = gaussian_kernel(sigma, truncate);
+				int method[3];
+				smooth_plan(h.dim, w, method);
+				cout << "\tkernel radius " << w[0].size() / 2 << ", "
+					 << (method[0] == SMOOTH_FFT? "FFT" : "direct") << " "
+					 << (method[1] == SMOOTH_FFT? "FFT" : "direct") << " "
+					 << (method[2] == SMOOTH_FFT? "FFT" : "direct") << endl;
+				smooth_separable(vol, h.dim, w, SMOOTH_REFLECT, threads, method);
+				h.thd = thd;
+				if (log) write_volume(prefix + ".vol", h, vol);
+				grid_from_volume(h, vol, G);
+				gridready = true;
+				M.count("voxels", G.vertices());
+			}
+
+			else if (action == "triangulation"){
+				Stage st(M, "triangulation");
+				if (!gridready){
+					if (load_volume(input, h, G) != 0) return 1;
+					gridready = true;
+					M.count("voxels", G.vertices());
+				}
+				int nb = para.get<int>("fill", 0)? 16 : 12;
+				cout << "[DiMorSC]\tTriangulating " << G.vertices() << " voxels" << endl;
+				G.triangulate(nb);
+				cout << "\t" << G.vertices() << " vertices, " << G.edges() << " edges, "
+					 << G.triangles() << " triangles\n";
+				M.count("vertices", G.vertices());
+				M.count("edges", G.edges());
+				M.count("triangles", G.triangles());
+				if (log) G.write_sc(prefix + ".sc");
+				triangulated = true;
+			}
+
+			else if (action == "DiMorSC"){
+				if (!triangulated){
+					cout << "DiMorSC needs a triangulation action first" << endl;
+					return 1;
+				}
+				double delta = para.get<double>("threshold");
+				int threads = para.get<int>("threads", 1);
+				if (threads <= 0) threads = thread::hardware_concurrency();
+				cout << "[DiMorSC]\tPersistence threshold " << delta << endl;
+
+				cout << "Building simplicial complex...\n";
+				Stage build(M, "build_complex");
+				K.setReorder(para.get<bool>("reorder", false));
+				K.buildComplexFromArrays(G.vert, G.edge, G.tri, threads);
+				G = GridComplex();
+				build.stop();
+				cout << "Building pseudo-Morse function...\n";
+				Stage morse(M, "morse_function");
+				K.buildPsuedoMorseFunction(threads);
+				morse.stop();
+				cout << "Building filtration...\n";
+				Stage filt(M, "filtration");
+				K.buildFiltrationWithLowerStar(threads);
+				filt.stop();
+				M.count("filtration", K.fsize());
+				cout << "Computing persistence pairs...\n";
+				Stage pers(M, "persistence");
+				K.PhatPersistence();
+				pers.stop();
+				M.count("ms_pairs", K.mssize());
+				M.count("sm_pairs", K.smsize());
+				if (log){
+					cout << "Writing pre_saved_data...\n";
+					Stage save(M, "write_presave");
+					K.write_presave(prefix);
+					K.write_snapshot(prefix + ".snap");
+				}
+				cout << "Cancelling persistence pairs with delta " << delta << "\n";
+				Stage cancel(M, "cancel");
+				K.cancelPersistencePairs(delta);
+				cancel.stop();
+				M.count("cancellations", K.cancelsize());
+				Stage arcs(M, "collect_arcs");
+				K.collectArcs(delta, sk);
+				arcs.stop();
+				M.count("arc_vertices", sk.vcrit.size());
+				M.count("arc_edges", sk.ecrit.size());
+				if (log){
+					write_skeleton(sk, prefix + "_vert.txt", prefix + "_edge.txt");
+					ofstream ini(prefix + ".ini");
+					ini << basename(prefix) << "_vert.txt\n" << basename(prefix) << "_edge.txt\n";
+				}
+				skeletonready = true;
+			}
+
+			else if (action == "to_tree"){
+				if (!skeletonready){
+					cout << "to_tree needs a DiMorSC action first" << endl;
+					return 1;
+				}
+				vector<int> root;
+				istringstream iss(para.get<string>("root", "0 0 0"));
+				int x;
+				while(iss >> x) root.push_back(x);
+				int comp = para.get<int>("component", 0);
+				int threads = para.get<int>("threads", 1);
+				if (threads <= 0) threads = thread::hardware_concurrency();
+				cout << "[DiMorSC]\tgraph2tree" << endl;
+				Stage st(M, "to_tree");
+				graph T(sk.vert, sk.edge);
+				M.count("trees", T.extract_trees(root, comp, prefix, threads));
+			}
+
+			else{
+				cout << "Unknown action " << action << endl;
+				return 1;
+			}
+		}
+	}catch(pt::ptree_error &e){
+		cout << "Error in " << argv[2] << ": " << e.what() << endl;
+		return 1;
+	}
+	if (M.write(prefix + "_metrics.json") != 0) return 1;
+	return 0;
+}
@@ -5,7 +5,19 @@ Author: Suyi Wang
 
 Input: output/<id>_dens.bin
 Output: <id>_dens.bin
-Complie: g++ Gsmooth.cpp -static-libstdc++ -I boost_1_64_0/ -std=c++11 -o Gsmooth -w
+Complie: g++ Gsmooth.cpp -O2 -static-libstdc++ -I../core -std=c++11 -pthread -o Gsmooth -w
+
+ini file, one number per line:
+	threshold, id, dimension (2/3), step size x, y, z
+	[threads]	optional, default 1, 0 for all cores
+	[sigma]		optional, default 3
+	[radius]	optional kernel window in physical units, default 2/3 sigma
+				(the 5x5x3 window for sigma 3 and step size 1 1 2)
+
+Points are placed on a dense grid over their bounding box (padded by the
+kernel radius) and smoothed with a separable Gaussian, one 1D pass per axis.
+Every voxel within the kernel window of an input point is written out if its
+value is at least the threshold.
 */
 
 
@@ -17,13 +29,10 @@ Complie: g++ Gsmooth.cpp -static-libstdc++ -I boost_1_64_0/ -std=c++11 -o Gsmoot
 #include<algorithm>
 #include<time.h>
 #include<cstdlib>
-// #include<unordered_map>
-// #include<unordered_set>
+#include<cmath>
+#include<climits>
 
-#include <boost/tuple/tuple.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
-#include <boost/unordered_set.hpp>
-#include <boost/unordered_map.hpp>
+#include "smooth.h"
 
 using namespace std;
 
@@ -35,51 +44,23 @@ struct point{
 	bool in_bbox;
 };
 
-int vertcount = 0;
 vector<point> vertex;
 
 
-// *********** begin vertex pair***********
-std::size_t hash_value(const point &pt){
-  std::size_t seed = 0;
-  boost::hash_combine(seed, pt.x);
-  boost::hash_combine(seed, pt.y);
-  boost::hash_combine(seed, pt.z);
-  return seed;
-}
-
-bool operator==(const point &a, const point &b)
-{
-  return a.x == b.x && a.y == b.y && a.z == b.z;
-}
+// Dense grid over the bounding box of the input points
+struct Grid{
+	int lo[3];					// grid position of voxel 0
+	int dim[3];
+	vector<double> val;
+	vector<char> mask;			// voxels written to the output
 
-class VertexHash{
-    private:
-        boost::unordered_map<point, int> v_hash;
-    public:
-        VertexHash(){
-            v_hash.clear();
-        }
-        int GetIndex(point p){
-            if (v_hash.count(p) > 0)
-                return v_hash[p];
-            else
-                return -1;
-        }
-        void InsertVertex(point p, int n){
-            v_hash.insert(make_pair(p, n));
-        }
-        int size(){return v_hash.size();}
-        boost::unordered_map<point, int>::iterator begin(){
-            return v_hash.begin();
-        }
-        boost::unordered_map<point, int>::iterator end(){
-            return v_hash.end();
-        }
+	long at(int x, int y, int z){
+		return ((long)(z - lo[2]) * dim[1] + (y - lo[1])) * dim[0] + (x - lo[0]);
+	}
 };
-// *********** End of vertex pair ***********
 
-VertexHash vh;
+Grid grid;
+
 
 void init_3D(double selTHD, string filename){
 	vertex.clear();
@@ -118,13 +99,7 @@ void init_3D(double selTHD, string filename){
 
         point p;
         p.x = i; p.y = j; p.z = k; p.v = v;
-        int idx = -1;
-        idx = vh.GetIndex(p);
-        if (idx < 0){
-	        vertex.push_back(p);
-	        vh.InsertVertex(p, vertcount);
-	        vertcount++;
-	    }
+        vertex.push_back(p);
     }
     binaryIO.close();
     printf("done\n");
@@ -136,23 +111,24 @@ void bin_output(string id, double selTHD){
     ofstream ofs(vname,ios::binary);
     printf("writing vertex\n");
     
+    int count = 0;
+    for (long n = 0; n < (long)grid.val.size(); n++)
+        if (grid.mask[n] && !(grid.val[n] < selTHD)) count++;
+    ofs.write((char*) &count, sizeof(int) * 1);
+    if (DEBUG) cout << "Writing " << count << " points" << endl;
     
-    char* header_data = new char[sizeof(int) * 1];
-    int* header_buffer = (int*) header_data;
-    header_buffer[0] = vertex.size();
-    ofs.write(header_data, sizeof(int) * 1);
-    if (DEBUG) cout << "Writing " << header_buffer[0] << " points" << endl;
-    
-    
-    char* vert = new char[sizeof(double) * 4];
-    double* vert_buffer = (double*) vert;
-    for (int i = 0; i < vertex.size(); i++){
-        if (vertex[i].v < selTHD) continue;
-    	vert_buffer[0] = vertex[i].x; vert_buffer[1] = vertex[i].y;
-    	vert_buffer[2] = vertex[i].z; vert_buffer[3] = vertex[i].v;
-		ofs.write(vert, sizeof(double) * 4);
-    }
+    double vert_buffer[4];
+    long n = 0;
+    for (int k = 0; k < grid.dim[2]; k++)
+        for (int j = 0; j < grid.dim[1]; j++)
+            for (int i = 0; i < grid.dim[0]; i++, n++){
+                if (!grid.mask[n] || grid.val[n] < selTHD) continue;
+                vert_buffer[0] = grid.lo[0] + i; vert_buffer[1] = grid.lo[1] + j;
+                vert_buffer[2] = grid.lo[2] + k; vert_buffer[3] = grid.val[n];
+                ofs.write((char*) vert_buffer, sizeof(double) * 4);
+            }
     ofs.close();
+    printf("%d points written\n", count);
 }
 
 //  TO DO
@@ -188,13 +164,7 @@ void init_2D(string filename){
 
         point p;
         p.x = i; p.y = j; p.z = 0; p.v = v;
-        int idx = -1;
-        idx = vh.GetIndex(p);
-        if (idx < 0){
-	        vertex.push_back(p);
-	        vh.InsertVertex(p, vertcount);
-	        vertcount++;
-	    }
+        vertex.push_back(p);
     }
     binaryIO.close();
     printf("done\n");
@@ -219,67 +189,87 @@ vector<double> read_ini(string ini_filename){
         else
             cerr << "Reached EOF, ini file error\n";
     }
+    // optional fields
+    while(fscanf(fp, "%lf", &rd) == 1)
+        rtn.push_back(rd);
     fclose(fp);
     return rtn;
 }
 
-double norm_const = 1;
-int diffuse(point p, vector<double> stepsize){
-	double sigma = 3;
-	int sum = 0;
-	for (int i = -2; i <= 2; ++i)
-		for(int j = -2; j <= 2; ++j)
-			for(int k = -1; k <= 1; ++k){
-				point dif_p;
-				
-				dif_p.x = p.x + i;
-				dif_p.y = p.y + j;
-				dif_p.z = p.z + k;
-                double x = i*stepsize[0];
-                double y = j*stepsize[1];
-                double z = k*stepsize[2];
-				dif_p.v = p.v * norm_const * exp(-(x*x + y*y + z*z)/(2* sigma * sigma));
-				
-				/*if (dif_p.v < 1e-8) {
-					continue;
-				}*/
-				
-				int idx = vh.GetIndex(dif_p);
-				if (idx < 0){
-					vh.InsertVertex(dif_p, vertcount);
-					vertex.push_back(dif_p);
-					vertcount++;
-				}else{
-					vertex[idx].v += dif_p.v;
-				}
-    }
-    return sum;
+// Per-axis window of the kernel in voxels
+int kernel_radius(double radius, double step){
+    return (int)ceil(radius / step - 1e-9);
 }
 
-double kernel_init(double sigma, vector<double> stepsize){
-	double sum = 0;
-    for(int k = -1; k <= 1; ++k){
-        for (int i = -2; i <= 2; ++i)
-            for(int j = -2; j <= 2; ++j){
-                double x = i*stepsize[0];
-                double y = j*stepsize[1];
-                double z = k*stepsize[2];
-				sum += exp(-(x*x + y*y + z*z)/(2* sigma * sigma));
-				if (DEBUG) cout << exp(-(x*x + y*y + z*z)/(2* sigma * sigma)) 
-                                << " ";
-			}
-		if (DEBUG) cout << "\n\n";
+// exp(-(x*x + y*y + z*z)/(2 sigma^2)) over the window, normalized to sum 1,
+// factored into one 1D kernel per axis.
+void kernel_init(double sigma, double radius, vector<double> stepsize, vector<double> w[3]){
+    for (int d = 0; d < 3; ++d){
+        w[d].assign(1, 1.0);
+        if (d >= (int)stepsize.size()) continue;
+        int r = kernel_radius(radius, stepsize[d]);
+        w[d].assign(2 * r + 1, 0);
+        double sum = 0;
+        for (int i = -r; i <= r; ++i){
+            double x = i * stepsize[d];
+            w[d][i + r] = exp(-(x*x)/(2* sigma * sigma));
+            sum += w[d][i + r];
+        }
+        for (auto &v : w[d]) v /= sum;
+        if (DEBUG){
+            for (auto v : w[d]) cout << v << " ";
+            cout << "\n";
+        }
     }
-    return 1.0/sum;
 }
 
 
-void smooth3D(vector<double> steps){
-    int LEN = vertex.size();
-    for(int i = 0; i < LEN; ++i){
-        if (DEBUG && i%1000 == 0) cout << i << endl;
-        diffuse(vertex[i], steps);
+// Places the points on the grid; the first point at a position wins
+void grid_init(const int r[3]){
+    int hi[3] = {INT_MIN, INT_MIN, INT_MIN};
+    for (int d = 0; d < 3; ++d) grid.lo[d] = INT_MAX;
+    for (auto &p : vertex){
+        int c[3] = {p.x, p.y, p.z};
+        for (int d = 0; d < 3; ++d){
+            grid.lo[d] = min(grid.lo[d], c[d]);
+            hi[d] = max(hi[d], c[d]);
+        }
+    }
+    if (vertex.empty())
+        for (int d = 0; d < 3; ++d) grid.lo[d] = hi[d] = 0;
+    for (int d = 0; d < 3; ++d){
+        grid.lo[d] -= r[d];
+        grid.dim[d] = hi[d] + r[d] - grid.lo[d] + 1;
+    }
+    long size = (long)grid.dim[0] * grid.dim[1] * grid.dim[2];
+    printf("Grid %d x %d x %d\n", grid.dim[0], grid.dim[1], grid.dim[2]);
+    grid.val.assign(size, 0);
+    grid.mask.assign(size, 0);
+    for (auto &p : vertex){
+        long n = grid.at(p.x, p.y, p.z);
+        if (grid.mask[n]) continue;
+        grid.mask[n] = 1;
+        grid.val[n] = p.v;
     }
+    vertex.clear();
+    vertex.shrink_to_fit();
+}
+
+
+void smooth3D(vector<double> steps, double sigma, double radius, int threads){
+    vector<double> w[3];
+    kernel_init(sigma, radius, steps, w);
+    int r[3];
+    for (int d = 0; d < 3; ++d) r[d] = w[d].size() / 2;
+    printf("Kernel radius %d %d %d\n", r[0], r[1], r[2]);
+    grid_init(r);
+    int method[3];
+    smooth_plan(grid.dim, w, method);
+    const char *axis = "xyz";
+    for (int d = 0; d < 3; ++d)
+        printf("Axis %c: %s\n", axis[d], method[d] == SMOOTH_FFT? "FFT" : "direct");
+    smooth_separable(grid.val, grid.dim, w, SMOOTH_ZERO, threads, method);
+    dilate_separable(grid.mask, grid.dim, r, threads);
 }
 
 
@@ -322,12 +312,15 @@ int main(int argc, char* argv[])
         steps.push_back(ini[4]);
 		init_2D(filename);
     }
-    norm_const = kernel_init(3.0, steps);
     printf("Applying Gaussian Kernel\n");
-    if (dimension == 3)
-		smooth3D(steps);
-	else
-		smooth3D(steps);// should be 2D
+    int threads = ini.size() > 6? round(ini[6]) : 1;
+    if (threads <= 0) threads = thread::hardware_concurrency();
+    printf("Using %d threads\n", threads);
+    double sigma = ini.size() > 7? ini[7] : 3.0;
+    double radius = ini.size() > 8? ini[8] : 2.0 * sigma / 3.0;
+    printf("Sigma %g, radius %g\n", sigma, radius);
+    // 2D: no step size along z, the kernel is flat in z
+    smooth3D(steps, sigma, radius, threads);
 
     printf("Writing output\n");
     bin_output(id, selTHD);
@@ -6,6 +6,9 @@ Input: mapinput.txt
 Output: vert.txt edge.txt triangle.txt
 
 Comments: Vertex index start from 0. All edges and triangles uses vertex index.
+Modes 2 and 3 stream the input plane by plane and need it sorted by z;
+otherwise they stop without output and exit with status 1.
+Stage times and sizes are written to <input name>_metrics.json.
 */
 
 
@@ -20,6 +23,7 @@ Comments: Vertex index start from 0. All edges and triangles uses vertex index.
 #include<algorithm>
 #include<time.h>
 #include<cstdlib>
+#include<thread>
 // #include<unordered_map>
 // #include<unordered_set>
 
@@ -30,6 +34,10 @@ Comments: Vertex index start from 0. All edges and triangles uses vertex index.
 
 using namespace std;
 
+#include "cubetri.h"
+#include "volume.h"
+#include "metrics.h"
+
 #define DEBUG 0
 #define complexhash 0
 
@@ -37,6 +45,8 @@ using namespace std;
 // Do     fill inner part of a cube - 16
 int nb = 12;
 
+Metrics metrics("Triangulate");
+
 struct point{
 	int x,y,z;
 	double v;
@@ -108,9 +118,11 @@ class VertexHash{
         VertexHash(){
             v_hash.clear();
         }
-        int GetIndex(point p){
-            if (v_hash.count(p) > 0)
-                return v_hash[p];
+        int GetIndex(point p) const{
+            // lookup only, safe to call from several threads
+            auto it = v_hash.find(p);
+            if (it != v_hash.end())
+                return it->second;
             else
                 return -1;
         }
@@ -550,6 +562,514 @@ int triangulation_with_vertex(){
 }
 
 
+// Canonical ownership: cubes emit only the simplices they own (see cubetri.h)
+// so EdgeHash and TriangleHash are not needed.
+int seed_total = 0;
+
+struct SeedLookup{
+	// true if the cube at (x,y,z) is triangulated, i.e. (x,y,z) is an input point
+	bool operator()(int x, int y, int z){
+		point p;
+		p.x = x; p.y = y; p.z = z;
+		int idx = vh.GetIndex(p);
+		if (idx < 0 || idx >= seed_total) return false;
+		int val = vertex[idx].v;
+		return !(val < -1e-6);
+	}
+};
+
+
+/*
+Slab-parallel triangulation.
+	Seeds (input points that start a cube) are sorted by (z, y, x) and cut
+	into z-slabs, one per thread. A padding vertex belongs to the smallest
+	seed cube containing it, so each slab creates its own padding vertices
+	in a local buffer and refers to padding of earlier slabs through a
+	fixup list. Afterwards a prefix sum over slab sizes gives global ids.
+	Concatenating the slabs reproduces the single-thread order exactly.
+*/
+struct SlabBuffer{
+	int begin, end;				// range in sorted seed list
+	vector<point> pad;			// padding vertices owned by this slab
+	VertexHash pad_hash;		// padding vertex -> index in pad
+	vector<point> foreign;		// padding vertices owned by earlier slabs
+	vector<int> edge;			// 2 refs per edge
+	vector<int> tri;			// 3 refs per triangle
+	vector<int> edge_fix;		// slots of edge holding an index into foreign
+	vector<int> tri_fix;		// slots of tri holding an index into foreign
+	int base;					// global id of pad[0]
+};
+
+vector<int> seed_order;
+
+bool seed_less(int a, int b){
+	if (vertex[a].z != vertex[b].z) return vertex[a].z < vertex[b].z;
+	if (vertex[a].y != vertex[b].y) return vertex[a].y < vertex[b].y;
+	return vertex[a].x < vertex[b].x;
+}
+
+// smallest seed cube containing corner p
+point padding_owner(point p, SeedLookup &is_seed){
+	point rtn;
+	for(int dz = 1; dz >= 0; --dz)
+		for(int dy = 1; dy >= 0; --dy)
+			for(int dx = 1; dx >= 0; --dx)
+				if (is_seed(p.x - dx, p.y - dy, p.z - dz)){
+					rtn.x = p.x - dx; rtn.y = p.y - dy; rtn.z = p.z - dz;
+					return rtn;
+				}
+	return p;
+}
+
+void triangle_cube_slab(int i, int j, int k, int AB, SlabBuffer &slab, SeedLookup &is_seed){
+	CubeTable &tab = cube_table[AB];
+	// reference of each corner: >= 0 vertex id, < 0 local padding, or foreign
+	int sub[8];
+	bool foreign[8];
+	for(auto c : tab.corners){
+		point p;
+		p.x = i + cube_offset(c, 0);
+		p.y = j + cube_offset(c, 1);
+		p.z = k + cube_offset(c, 2);
+		foreign[c] = false;
+		sub[c] = vh.GetIndex(p);
+		if (sub[c] >= 0) continue;
+
+		int local = slab.pad_hash.GetIndex(p);
+		if (local < 0){
+			point owner = padding_owner(p, is_seed);
+			if (owner.x == i && owner.y == j && owner.z == k){
+				p.v = 1e-6;
+				local = slab.pad.size();
+				slab.pad_hash.InsertVertex(p, local);
+				slab.pad.push_back(p);
+			}else{
+				// created by a cube of an earlier slab
+				foreign[c] = true;
+				sub[c] = slab.foreign.size();
+				slab.foreign.push_back(p);
+				continue;
+			}
+		}
+		sub[c] = -1 - local;
+	}
+
+	for(auto &t : tab.triangles){
+		if (!cube_owns(i, j, k, t, is_seed)) continue;
+		for(int n = 0; n < 3; ++n){
+			if (foreign[t.c[n]]) slab.tri_fix.push_back(slab.tri.size());
+			slab.tri.push_back(sub[t.c[n]]);
+		}
+	}
+
+	for(auto &e : tab.edges){
+		if (!cube_owns(i, j, k, e, is_seed)) continue;
+		for(int n = 0; n < 2; ++n){
+			if (foreign[e.c[n]]) slab.edge_fix.push_back(slab.edge.size());
+			slab.edge.push_back(sub[e.c[n]]);
+		}
+	}
+}
+
+void triangulate_slab(SlabBuffer *slab){
+	SeedLookup is_seed;
+	for(int s = slab->begin; s < slab->end; ++s){
+		point &p = vertex[seed_order[s]];
+		triangle_cube_slab(p.x, p.y, p.z, cube_type(p.x, p.y, p.z), *slab, is_seed);
+	}
+}
+
+int find_slab(const vector<SlabBuffer> &slabs, point p){
+	SeedLookup is_seed;
+	point owner = padding_owner(p, is_seed);
+	// last slab whose first seed is not after owner
+	for(int t = slabs.size() - 1; t >= 0; --t){
+		if (slabs[t].begin == slabs[t].end) continue;
+		point &first = vertex[seed_order[slabs[t].begin]];
+		if (first.z < owner.z || (first.z == owner.z && (first.y < owner.y ||
+			(first.y == owner.y && first.x <= owner.x))))
+			return t;
+	}
+	return 0;
+}
+
+// turn slab refs into global vertex ids
+void resolve_slab(vector<SlabBuffer> *slabs, int t){
+	SlabBuffer &slab = (*slabs)[t];
+	vector<int> fixed(slab.foreign.size());
+	for(int f = 0; f < (int)slab.foreign.size(); ++f){
+		SlabBuffer &owner = (*slabs)[find_slab(*slabs, slab.foreign[f])];
+		fixed[f] = owner.base + owner.pad_hash.GetIndex(slab.foreign[f]);
+	}
+	for(auto &r : slab.edge) if (r < 0) r = slab.base - 1 - r;
+	for(auto &r : slab.tri) if (r < 0) r = slab.base - 1 - r;
+	for(auto pos : slab.edge_fix) slab.edge[pos] = fixed[slab.edge[pos]];
+	for(auto pos : slab.tri_fix) slab.tri[pos] = fixed[slab.tri[pos]];
+}
+
+void copy_slab(const SlabBuffer *slab, int voff, int eoff, int toff){
+	for(int n = 0; n < (int)slab->pad.size(); ++n)
+		vertex[voff + n] = slab->pad[n];
+	for(int n = 0; n < (int)slab->edge.size() / 2; ++n){
+		cp new_edge;
+		new_edge.p1 = slab->edge[2*n]; new_edge.p2 = slab->edge[2*n+1];
+		new_edge.Reorder();
+		edge[eoff + n] = new_edge;
+	}
+	for(int n = 0; n < (int)slab->tri.size() / 3; ++n){
+		tp new_triangle;
+		new_triangle.p1 = slab->tri[3*n]; new_triangle.p2 = slab->tri[3*n+1];
+		new_triangle.p3 = slab->tri[3*n+2];
+		new_triangle.Reorder();
+		triangle[toff + n] = new_triangle;
+	}
+}
+
+int triangulation_owner(int nthreads){
+	double THD = -1e-6;
+	int original_total = vertex.size();
+	seed_total = original_total;
+	cube_init(nb);
+
+	seed_order.clear();
+	for(int v = 0; v < original_total; ++v){
+		int val = vertex[v].v;
+		if (val < THD) {
+			cout << "skipped something\n";
+			continue;
+		}
+		seed_order.push_back(v);
+	}
+	stable_sort(seed_order.begin(), seed_order.end(), seed_less);
+
+	// cut sorted seeds into z-slabs of similar size
+	if (nthreads < 1) nthreads = 1;
+	vector<SlabBuffer> slabs(nthreads);
+	int total = seed_order.size();
+	int start = 0;
+	for(int t = 0; t < nthreads; ++t){
+		int stop = (long long)total * (t + 1) / nthreads;
+		if (stop < start) stop = start;
+		while (stop > start && stop < total &&
+			   vertex[seed_order[stop]].z == vertex[seed_order[stop-1]].z)
+			stop++;
+		slabs[t].begin = start; slabs[t].end = stop;
+		start = stop;
+	}
+	printf("Triangulating %d cubes in %d slabs\n", total, nthreads);
+
+	vector<thread> workers;
+	for(int t = 1; t < nthreads; ++t)
+		workers.push_back(thread(triangulate_slab, &slabs[t]));
+	triangulate_slab(&slabs[0]);
+	for(auto &w : workers) w.join();
+	workers.clear();
+
+	// prefix sums
+	vector<int> voff(nthreads), eoff(nthreads), toff(nthreads);
+	int vsum = original_total, esum = 0, tsum = 0;
+	for(int t = 0; t < nthreads; ++t){
+		slabs[t].base = vsum;
+		voff[t] = vsum; eoff[t] = esum; toff[t] = tsum;
+		vsum += slabs[t].pad.size();
+		esum += slabs[t].edge.size() / 2;
+		tsum += slabs[t].tri.size() / 3;
+	}
+
+	for(int t = 1; t < nthreads; ++t)
+		workers.push_back(thread(resolve_slab, &slabs, t));
+	resolve_slab(&slabs, 0);
+	for(auto &w : workers) w.join();
+	workers.clear();
+
+	vertex.resize(vsum); edge.resize(esum); triangle.resize(tsum);
+	vertcount = vsum;
+	for(int t = 1; t < nthreads; ++t)
+		workers.push_back(thread(copy_slab, &slabs[t], voff[t], eoff[t], toff[t]));
+	copy_slab(&slabs[0], voff[0], eoff[0], toff[0]);
+	for(auto &w : workers) w.join();
+
+	printf("Done\n");
+	return 0;
+}
+
+
+/*
+Streaming triangulation for volumes larger than memory.
+	The input must be sorted by z. Points are read one z-plane at a time and
+	only the index state of planes z-1, z and z+1 is kept: vertex ids of the
+	two planes touched by the cubes of plane z, and the seeds of z-1 and z+1
+	needed by the ownership rule. Vertex, edge and triangle records are
+	appended to temporary block files and concatenated with their counts at
+	the end, so memory is bounded by the plane size.
+*/
+struct StreamPlane{
+	int z;
+	vector<point> seeds;							// cubes of this plane, input order
+	boost::unordered_map<long long, long long> id;	// (x,y) -> vertex id
+	boost::unordered_set<long long> seed;			// (x,y) of seeds
+};
+
+inline long long plane_key(int x, int y){
+	return ((long long)x << 32) | (unsigned int)y;
+}
+
+// Appends fixed size records to a temporary file in large blocks
+class BlockFile{
+	private:
+		ofstream ofs;
+		vector<char> buffer;
+		long long count;
+	public:
+		string name;
+		void open(string filename){
+			name = filename;
+			ofs.open(name.c_str(), ios::binary | ios::trunc);
+			buffer.clear(); buffer.reserve(1 << 22);
+			count = 0;
+		}
+		void append(const void *data, int bytes){
+			const char *c = (const char*) data;
+			buffer.insert(buffer.end(), c, c + bytes);
+			if (buffer.size() >= (1 << 22)) flush();
+			count++;
+		}
+		void flush(){
+			ofs.write(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+		void close(){
+			flush();
+			ofs.close();
+		}
+		long long size(){return count;}
+};
+
+struct StreamState{
+	ifstream input;
+	long long remaining;		// points not read yet
+	bool has_next;
+	point next;					// lookahead point
+	BlockFile vfile, efile, tfile;
+	long long vcount;
+	StreamPlane *prev, *cur, *upper;
+};
+
+bool stream_read_point(StreamState &st){
+	if (st.remaining <= 0){
+		st.has_next = false;
+		return false;
+	}
+	double d[4];
+	st.input.read((char*) d, sizeof(double) * 4);
+	st.remaining--;
+	st.next.x = floor(d[0] + 0.5);
+	st.next.y = floor(d[1] + 0.5);
+	st.next.z = floor(d[2] + 0.5);
+	st.next.v = d[3];
+	st.has_next = true;
+	return true;
+}
+
+long long stream_add_vertex(StreamState &st, StreamPlane &plane, point p){
+	double d[4] = {(double)p.x, (double)p.y, (double)p.z, p.v};
+	st.vfile.append(d, sizeof(double) * 4);
+	plane.id[plane_key(p.x, p.y)] = st.vcount;
+	return st.vcount++;
+}
+
+// read all points of plane z; ids are assigned in input order
+int stream_read_plane(StreamState &st, StreamPlane &plane, int z){
+	double THD = -1e-6;
+	plane.z = z;
+	plane.seeds.clear(); plane.id.clear(); plane.seed.clear();
+	while (st.has_next && st.next.z == z){
+		point p = st.next;
+		if (plane.id.count(plane_key(p.x, p.y)) == 0){	// keep the first duplicate
+			stream_add_vertex(st, plane, p);
+			int val = p.v;
+			if (!(val < THD)){
+				plane.seeds.push_back(p);
+				plane.seed.insert(plane_key(p.x, p.y));
+			}
+		}
+		stream_read_point(st);
+		if (st.has_next && st.next.z < z){
+			printf("Input is not sorted by z, streaming needs z-sorted points\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+struct StreamSeedLookup{
+	StreamState *st;
+	bool operator()(int x, int y, int z){
+		StreamPlane *plane = NULL;
+		if (z == st->prev->z) plane = st->prev;
+		else if (z == st->cur->z) plane = st->cur;
+		else if (z == st->upper->z) plane = st->upper;
+		if (plane == NULL) return false;
+		return plane->seed.count(plane_key(x, y)) > 0;
+	}
+};
+
+void triangle_cube_stream(int i, int j, int k, int AB, StreamState &st, StreamSeedLookup &is_seed){
+	CubeTable &tab = cube_table[AB];
+	long long sub[8];
+	for(auto c : tab.corners){
+		point p;
+		p.x = i + cube_offset(c, 0);
+		p.y = j + cube_offset(c, 1);
+		p.z = k + cube_offset(c, 2);
+		StreamPlane &plane = cube_offset(c, 2)? *st.upper : *st.cur;
+		auto it = plane.id.find(plane_key(p.x, p.y));
+		if (it != plane.id.end()){
+			sub[c] = it->second;
+		}else{
+			p.v = 1e-6;
+			sub[c] = stream_add_vertex(st, plane, p);
+		}
+	}
+
+	for(auto &t : tab.triangles){
+		if (!cube_owns(i, j, k, t, is_seed)) continue;
+		long long tri[3] = {sub[t.c[0]], sub[t.c[1]], sub[t.c[2]]};
+		sort(tri, tri + 3);
+		st.tfile.append(tri, sizeof(long long) * 3);
+	}
+
+	for(auto &e : tab.edges){
+		if (!cube_owns(i, j, k, e, is_seed)) continue;
+		long long ed[2] = {sub[e.c[0]], sub[e.c[1]]};
+		if (ed[0] > ed[1]) swap(ed[0], ed[1]);
+		st.efile.append(ed, sizeof(long long) * 2);
+	}
+}
+
+// copy vertex records and convert index records to the requested width
+void stream_concat(ofstream &ofs, BlockFile &block, int record, int fields, bool v2){
+	ifstream ifs(block.name.c_str(), ios::binary);
+	const long long chunk = 1 << 16;
+	vector<char> in(chunk * record);
+	vector<int> out(chunk * fields);
+	long long left = block.size();
+	while (left > 0){
+		long long n = left < chunk? left : chunk;
+		ifs.read(in.data(), n * record);
+		if (fields == 0 || v2){
+			ofs.write(in.data(), n * record);
+		}else{
+			long long *idx = (long long*) in.data();
+			for(long long m = 0; m < n * fields; ++m) out[m] = (int) idx[m];
+			ofs.write((char*) out.data(), n * fields * sizeof(int));
+		}
+		left -= n;
+	}
+	ifs.close();
+	remove(block.name.c_str());
+}
+
+void stream_write_count(ofstream &ofs, long long n, bool v2){
+	if (v2){
+		ofs.write((char*) &n, sizeof(long long));
+	}else{
+		int n32 = n;
+		ofs.write((char*) &n32, sizeof(int));
+	}
+}
+
+int stream_abort(StreamState &st){
+	st.vfile.close(); st.efile.close(); st.tfile.close();
+	remove(st.vfile.name.c_str());
+	remove(st.efile.name.c_str());
+	remove(st.tfile.name.c_str());
+	return -1;
+}
+
+int triangulation_stream(string filename, bool v2){
+	cube_init(nb);
+	StreamState st;
+	st.input.open(filename.c_str(), ios::binary);
+	if (!st.input.is_open()){
+		printf("Error opening file\n");
+		return -1;
+	}
+	int LENGTH;
+	st.input.read((char*) &LENGTH, sizeof(int));
+	st.remaining = LENGTH;
+	printf("Streaming 3D density matrix: total %d Lines\n", LENGTH);
+
+	string outname = rmvExt(filename) + ".sc";
+	st.vfile.open(outname + ".vert.tmp");
+	st.efile.open(outname + ".edge.tmp");
+	st.tfile.open(outname + ".tri.tmp");
+	st.vcount = 0;
+
+	StreamPlane planes[3];
+	st.prev = &planes[0]; st.cur = &planes[1]; st.upper = &planes[2];
+	StreamSeedLookup is_seed;
+	is_seed.st = &st;
+
+	stream_read_point(st);
+	if (st.has_next && stream_read_plane(st, *st.cur, st.next.z) < 0) return stream_abort(st);
+	st.prev->z = st.cur->z - 1;
+	long long done = 0;
+	while (st.cur->seeds.size() > 0 || st.has_next){
+		int z = st.cur->z;
+		if (st.has_next && st.next.z == z + 1){
+			if (stream_read_plane(st, *st.upper, z + 1) < 0) return stream_abort(st);
+		}else{
+			st.upper->z = z + 1;
+			st.upper->seeds.clear(); st.upper->id.clear(); st.upper->seed.clear();
+		}
+
+		for(auto &p : st.cur->seeds)
+			triangle_cube_stream(p.x, p.y, p.z, cube_type(p.x, p.y, p.z), st, is_seed);
+		done += st.cur->seeds.size();
+		cout << '\r' << done << '/' << LENGTH;
+		cout.flush();
+
+		// slide the window by one plane
+		StreamPlane *tmp = st.prev;
+		st.prev = st.cur; st.cur = st.upper; st.upper = tmp;
+		if (st.cur->seeds.size() == 0 && st.has_next){
+			// gap in z: jump to the next plane with input points
+			st.prev->z = st.next.z - 1;
+			st.prev->seeds.clear(); st.prev->id.clear(); st.prev->seed.clear();
+			if (stream_read_plane(st, *st.cur, st.next.z) < 0) return stream_abort(st);
+		}
+	}
+	st.input.close();
+	st.vfile.close(); st.efile.close(); st.tfile.close();
+	printf("\nDone\n");
+
+	long long nv = st.vfile.size(), ne = st.efile.size(), nt = st.tfile.size();
+	if (!v2 && (nv > 2147483647LL || ne > 2147483647LL || nt > 2147483647LL)){
+		printf("Counts exceed int32, writing .sc v2 layout\n");
+		v2 = true;
+	}
+	printf("writing %lld vertices, %lld edges, %lld triangles\n", nv, ne, nt);
+	metrics.count("vertices", nv);
+	metrics.count("edges", ne);
+	metrics.count("triangles", nt);
+	ofstream ofs(outname, ios::binary);
+	if (v2){
+		// v2 layout: -2 marker, then int64 counts and indices
+		int marker = -2;
+		ofs.write((char*) &marker, sizeof(int));
+	}
+	stream_write_count(ofs, nv, v2);
+	stream_concat(ofs, st.vfile, sizeof(double) * 4, 0, v2);
+	stream_write_count(ofs, ne, v2);
+	stream_concat(ofs, st.efile, sizeof(long long) * 2, 2, v2);
+	stream_write_count(ofs, nt, v2);
+	stream_concat(ofs, st.tfile, sizeof(long long) * 3, 3, v2);
+	ofs.close();
+	return 0;
+}
+
+
 void triangle_2D(int i, int j, int AB){
 	if (AB == 0){ // Type A
         int TypeAtri[3*2][2] = {{0,0}, {1,0}, {0,1},
@@ -777,8 +1297,9 @@ void triangulation_2D(){
 
 int main(int argc, char* argv[])
 {
-	if (argc != 4){
-		cout << "usage: triangulation <density file> <fill> <2 (2D)/3 (3D)>\n";
+	if (argc < 4 || argc > 6){
+		cout << "usage: triangulation <density file> <fill> <2 (2D)/3 (3D)> [mode] [threads]\n"
+			 << "\tmodes 2 and 3 need input sorted by z\n";
 		return 0;
 	}
 	string filename(argv[1]);
@@ -786,26 +1307,87 @@ int main(int argc, char* argv[])
 	if (!fillnot) nb = 12;
 		else nb = 16;
 	int dimension = atoi(argv[3]);
+	// 0 - edge/triangle hashing
+	// 1 - canonical ownership (3D only)
+	// 2 - canonical ownership, streamed by z-plane (3D only)
+	// 3 - same as 2, writes .sc v2 layout with 64-bit counts
+	int mode = 0;
+	if (argc >= 5) mode = atoi(argv[4]);
+	// threads used by mode 1, 0 for all cores
+	int nthreads = 1;
+	if (argc >= 6) nthreads = atoi(argv[5]);
+	if (nthreads <= 0) nthreads = thread::hardware_concurrency();
 	
 	if(dimension == 2){
+		if (mode != 0){
+			cout << "mode " << mode << " is 3D only, 2D input is triangulated with mode 0\n";
+			return 1;
+		}
 		nb = 2;
 	}
 
+	if (dimension == 3 && filename.size() > 4 &&
+		filename.compare(filename.size() - 4, 4, ".vol") == 0){
+		// dense volume: threshold while reading, triangulate on the voxel grid
+		printf("Initializing volume input\n");
+		VolumeHeader header;
+		GridComplex G;
+		Stage read(metrics, "read");
+		if (load_volume(filename, header, G) < 0) return 1;
+		read.stop();
+		printf("Computing triangulation\n");
+		Stage tri(metrics, "triangulate");
+		G.triangulate(nb);
+		tri.stop();
+		metrics.count("vertices", G.vertices());
+		metrics.count("edges", G.edges());
+		metrics.count("triangles", G.triangles());
+		printf("Writing output\n");
+		Stage write(metrics, "write");
+		G.write_sc(rmvExt(filename) + ".sc");
+		write.stop();
+		metrics.write(rmvExt(filename) + "_metrics.json");
+		printf("Done\n");
+		return 0;
+	}
+
+	if (dimension == 3 && mode >= 2){
+		printf("Streaming triangulation\n");
+		Stage st(metrics, "stream_triangulate");
+		if (triangulation_stream(filename, mode == 3) != 0) return 1;
+		st.stop();
+		metrics.write(rmvExt(filename) + "_metrics.json");
+		printf("Done\n");
+		return 0;
+	}
+
     printf("Initializing input\n");
+	Stage read(metrics, "read");
     if (dimension ==3)
 		bin_init(filename);
 	else
 		init_2D(filename);
+	read.stop();
 
     printf("Computing triangulation\n");
-    if (dimension == 3)
+	Stage tri(metrics, "triangulate");
+    if (dimension == 3 && mode == 1)
+		triangulation_owner(nthreads);
+	else if (dimension == 3)
 		triangulation_with_vertex();
 	else
 		triangulation_2D();
+	tri.stop();
+	metrics.count("vertices", vertex.size());
+	metrics.count("edges", edge.size());
+	metrics.count("triangles", triangle.size());
 
     printf("Writing output\n");
+	Stage write(metrics, "write");
 	//bin_output(fileid);
     simplex_output(filename);
+	write.stop();
+	metrics.write(rmvExt(filename) + "_metrics.json");
 
     printf("Done\n");
     return 0;
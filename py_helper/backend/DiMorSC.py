@@ -8,8 +8,9 @@ Methods:
     
     private methods:
     (string) _Gsmooth(numpy.ndimage data, double sigma, double thd,
-    string filename):
+    string filename, tuple trans, string fmt):
         smoothes data and write result to filename
+        fmt 'dens' writes a point cloud, 'vol' a dense volume
 
     (string) _triangulate(int id, int fill, int dim):
         triangulate point cloud and write result as simplicial complex
@@ -61,13 +62,17 @@ def pipeline(data_ptr, parameters, workpath="output/"):
             
             _check_offset(data.shape, now_ptr)
 
+            # 'vol' writes the dense volume instead of a point cloud
+            fmt = para.get("format", "dens")
+
             # run
             file = _Gsmooth(
                         data, 
                         sigma, 
                         cut_thd,
                         workpath + now_ptr._get_name(),
-                        now_ptr.offset[0:3]
+                        now_ptr.offset[0:3],
+                        fmt
                         )
             
             # collect
@@ -155,17 +160,22 @@ def _rmvExt(filename):
     return filename.rsplit('.', 1)[0]
 
 
-def _Gsmooth(data, sigma = 2, thd = 0.01, filename = 'output/0', trans = (0,0,0)):
+def _Gsmooth(data, sigma = 2, thd = 0.01, filename = 'output/0', trans = (0,0,0),
+             fmt = 'dens'):
     smooth_data = ndimage.filters.gaussian_filter(data, sigma)
     #data = ndimage.filters.minimum_filter(data, [5,5,3])
     #data = ndimage.filters.uniform_filter(data, [7,7,3])
     
+    if fmt == 'vol':
+        fileWriter.write_volume(smooth_data, filename, thd, trans)
+        return filename + '.vol'
     fileWriter.write_bin(smooth_data, filename, thd, trans)
     return filename + '.dens'
 
 
 def _triangulate(filename='output/0.dens', fill=0, dim=3):
-    subprocess.call(["./bin/Triangulate",
+    # raises CalledProcessError instead of handing on a missing .sc
+    subprocess.check_call(["./bin/Triangulate",
           filename,
           str(fill),
           str(dim)
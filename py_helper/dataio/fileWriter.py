@@ -41,6 +41,32 @@ def write_bin(data, id, thd = -1, trans = [0, 0, 0]):
 	double_array.tofile(newFile)
 	newFile.close()
 
+
+'''
+Writes dense volume file for DiMorSC triangulation
+
+(numpy.ndarray) data, (string) id, (double) thd, (list) trans
+
+Same arguments as write_bin. The volume is written as is with a small
+header; Triangulate drops voxels with value <= thd while reading it.
+Header: nx ny nz (int32), dtype (int32), thd (double),
+        spacing x y z (double), offset x y z (int32)
+'''
+VOLUME_DTYPE = {'uint8': 1, 'uint16': 2, 'float32': 4, 'float64': 8}
+def write_volume(data, id, thd = -1, trans = [0, 0, 0]):
+	if str(data.dtype) not in VOLUME_DTYPE:
+		data = data.astype(numpy.float64)
+	newFile = open(id + ".vol", "wb")
+	nz, ny, nx = data.shape
+	newFile.write(struct.pack('iii', nx, ny, nz))
+	newFile.write(struct.pack('i', VOLUME_DTYPE[str(data.dtype)]))
+	newFile.write(struct.pack('d', thd))
+	newFile.write(struct.pack('ddd', 1.0, 1.0, 1.0))
+	newFile.write(struct.pack('iii', int(trans[2]), int(trans[1]), int(trans[0])))
+	numpy.ascontiguousarray(data).tofile(newFile)
+	print ("    [ImageWriter] \twritten %d x %d x %d volume."%(nx, ny, nz))
+	newFile.close()
+
 def write_string_list(slist, filename):
 	f = open(filename, 'w')
 	if f is not None:
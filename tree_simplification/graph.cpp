@@ -1,29 +1,41 @@
 #include"graph.h"
+#include"parallel.h"
 
 graph::graph(){
-	v.clear();
-	e.clear();
-	dist_created=0;
 }
 
 graph::graph(string vertfile, string edgefile){
-	graph();
 	loadvert(vertfile);
 	loadedge(edgefile);
+	build();
+}
+
+
+// Same layout as the _vert/_edge files: x y z f per vertex,
+// 1-based vertex indices per edge
+graph::graph(const vector<double> &vert, const vector<int> &edge){
+	for(size_t i = 0; i + 3 < vert.size(); i += 4)
+		v.push_back(point((int)lround(vert[i]), (int)lround(vert[i + 1]),
+						  (int)lround(vert[i + 2]), vert[i + 3]));
+	for(size_t i = 0; i + 1 < edge.size(); i += 2){
+		edge_in.push_back(edge[i] - 1);
+		edge_in.push_back(edge[i + 1] - 1);
+	}
+	build();
 }
 
 
 int graph::loadvert(const string & filename){
 	FILE* vertinput = fopen(filename.c_str(), "r");
+	if (vertinput == NULL){
+		cout << "Cannot open " << filename << endl;
+		return -1;
+	}
 	int x,y,z,c;
 	double f;
 	while(fscanf(vertinput, "%d%d%d%lf%d",&x,&y,&z,&f,&c)!=EOF){
 		//printf("%d %d %d %f %d\n", x,y,z,f,c);
-		point p;
-		p.pos.push_back(x);p.pos.push_back(y);p.pos.push_back(z);
-		p.f = f;
-		v.push_back(p);
-		e.push_back(vector<int>());
+		v.push_back(point(x, y, z, f));
 	}
 	fclose(vertinput);
 	return 0;
@@ -32,115 +44,166 @@ int graph::loadvert(const string & filename){
 
 int graph::loadedge(const string & filename){
 	FILE* edgeinput = fopen(filename.c_str(), "r");
+	if (edgeinput == NULL){
+		cout << "Cannot open " << filename << endl;
+		return -1;
+	}
 	int x,y,c;
 	double persist;
 	while(fscanf(edgeinput, "%d%d%d%lf",&x,&y,&c,&persist)!=EOF){
 		//printf("%d %d %d %f\n", x,y,c,persist);
 		// maybe need check redundancy.
-		// the edge is bi-directional
-		e[x-1].push_back(y-1);
-		//cout << x-1 << " " << y-1 <<endl;
-		e[y-1].push_back(x-1);
+		edge_in.push_back(x-1);
+		edge_in.push_back(y-1);
 	}
 	fclose(edgeinput);
 	return 0;
 }
 
 
+// CSR adjacency from edge_in; the edge is bi-directional and every row
+// keeps the order in which its edges were read
+int graph::build(){
+	int n = v.size();
+	start.assign(n + 1, 0);
+	int bad = 0;
+	for(size_t i = 0; i < edge_in.size(); i += 2){
+		int x = edge_in[i], y = edge_in[i + 1];
+		if (x < 0 || y < 0 || x >= n || y >= n){
+			bad++;
+			continue;
+		}
+		start[x + 1]++;
+		start[y + 1]++;
+	}
+	if (bad) cout << bad << " edges with invalid vertex ignored\n";
+	for(int i = 0; i < n; ++i) start[i + 1] += start[i];
+	adj.resize(start[n]);
+	vector<int> pos(start.begin(), start.end() - 1);
+	for(size_t i = 0; i < edge_in.size(); i += 2){
+		int x = edge_in[i], y = edge_in[i + 1];
+		if (x < 0 || y < 0 || x >= n || y >= n) continue;
+		adj[pos[x]++] = y;
+		adj[pos[y]++] = x;
+	}
+	vector<int>().swap(edge_in);
+	return 0;
+}
+
+
 int graph::check_redundancy(){
+	int n = v.size();
 	// check zero connectivity
-	vector<bool> rmvmark(v.size(), 0);
-	bool zerovert = false;
-	for(auto i = 0; i < e.size(); ++i)
-		if (e[i].size() == 0) {
-			rmvmark[i] = 1;
-			zerovert = true;
-		}
+	vector<int> remap(n, -1);
+	int realpointer = 0;
+	for(int i = 0; i < n; ++i)
+		if (start[i + 1] > start[i]) remap[i] = realpointer++;
 
-	if (zerovert){
+	if (realpointer < n){
 		cout << "Found and shrunk isolated vert.\n";
-		int realpointer = 0;
-		for(auto i = 0; i < e.size(); ++i){
+		for(int i = 0; i < n; ++i){
 			// skip without moving data
-			if (rmvmark[i]) continue;
-				
-			// copy data if i is in consistent with real
-			if(i != realpointer){
-				v[realpointer] = v[i];
-				e[realpointer] = e[i];
-			}
-			realpointer++;
+			if (remap[i] < 0) continue;
+			v[remap[i]] = v[i];
+			start[remap[i] + 1] = start[i + 1];
 		}
+		v.resize(realpointer);
+		start.resize(realpointer + 1);
+		for(auto &a : adj) a = remap[a];
+		n = realpointer;
 	}
 
 	// check redundant edge
+	// remove redundancy using sort and unique, rows are compacted in place
 	bool erased = false;
-	for(auto i = 0; i < e.size(); ++i){
-		// remove redundancy using unique
-		// if elemenent is huge, use set
-		sort( e[i].begin(), e[i].end() );
-		auto realend = unique(e[i].begin(), e[i].end());
-		if (realend!=e[i].end()){
-			e[i].erase(realend, e[i].end());
-			erased = true;
-		}
+	int out = 0;
+	for(int i = 0; i < n; ++i){
+		auto b = adj.begin() + start[i], e = adj.begin() + start[i + 1];
+		sort(b, e);
+		auto realend = unique(b, e);
+		if (realend != e) erased = true;
+		start[i] = out;
+		out = copy(b, realend, adj.begin() + out) - adj.begin();
 	}
+	start[n] = out;
+	adj.resize(out);
 	if (erased) cout << "Duplicate edges removed\n";
 	return 0;
 }
 
 
-graph graph::traverse(const int start, const vector<point> & v, const vector<vector<int> > & e, 
-					  vector<bool> & touched){
-	graph rtngraph;
-	// uses original idx
-	vector<int> queued_idx;
-	int visit=0;
-	queued_idx.push_back(start);
-	touched[start] = true;
-	// mapping original idx to new idx
-	unordered_map<int, int> idxmap;
-	idxmap[start] = 0;
-	rtngraph.v.push_back(v[start]);
-	rtngraph.e.push_back(vector<int>());
-
-
-	// loop when there is unvisited vertex
-	while(visit < queued_idx.size()){
-		int now = queued_idx[visit++];
-
-		// for every touched vert, put neighbours into queue
-		for(auto vert:e[now]){
-			if (!touched[vert]){
-				touched[vert] = true;
-				queued_idx.push_back(vert);
-				// copy new vert
-				idxmap[vert] = rtngraph.v.size();
-				rtngraph.v.push_back(v[vert]);
-				rtngraph.e.push_back(vector<int>());
-			}
-			// copy edges
-			// all appeared vert should be touched
-			rtngraph.e[idxmap[now]].push_back(idxmap[vert]);
-			rtngraph.e[idxmap[vert]].push_back(idxmap[now]);
+// Components ordered by their smallest vertex, found by union-find on
+// threads vertex ranges. Roots are always linked to the smaller root, so
+// a component's final root is its smallest vertex. Edge lengths are
+// computed here once for all components. Local ids are assigned per
+// component by bfs().
+vector<component> graph::split(int threads){
+	vector<component> rtn;
+	int n = v.size();
+
+	len.resize(adj.size());
+	parallel_for(n, threads, [&](long a, long b){
+		for(long i = a; i < b; ++i)
+			for(int k = start[i]; k < start[i + 1]; ++k)
+				len[k] = get_dist(v[i], v[adj[k]]);
+	});
+
+	vector<atomic<int> > parent(n);
+	for(int i = 0; i < n; ++i) parent[i].store(i, memory_order_relaxed);
+	auto find = [&](int x){
+		int p = parent[x].load(memory_order_relaxed);
+		while (p != x){
+			int gp = parent[p].load(memory_order_relaxed);
+			// path halving, any stale write still points towards the root
+			parent[x].compare_exchange_weak(p, gp, memory_order_relaxed);
+			x = gp;
+			p = parent[x].load(memory_order_relaxed);
 		}
-	}
-
-	return rtngraph;
-}
-
-
-vector<graph> graph::split(){
-	vector<graph> rtn;
-
-	vector<bool> touched(v.size(), false);
-	int vnum;
-	for(vnum = 0; vnum < (int)v.size(); vnum++){
-		if (!touched[vnum]){
-			graph g = traverse(vnum, v, e, touched);
-			rtn.push_back(g);
+		return x;
+	};
+	parallel_for(n, threads, [&](long a, long b){
+		for(long i = a; i < b; ++i)
+			for(int k = start[i]; k < start[i + 1]; ++k){
+				int x = i, y = adj[k];
+				if (y < x) continue;	// every edge is stored in both rows
+				while (true){
+					x = find(x); y = find(y);
+					if (x == y) break;
+					if (x < y) swap(x, y);
+					int expect = x;
+					if (parent[x].compare_exchange_strong(expect, y)) break;
+				}
+			}
+	});
+
+	// component of every vertex, numbered by smallest vertex
+	local.assign(n, -1);
+	vector<int> root(n);
+	parallel_for(n, threads, [&](long a, long b){
+		for(long i = a; i < b; ++i) root[i] = find(i);
+	});
+	vector<int> count;
+	for(int i = 0; i < n; ++i){
+		if (root[i] == i){
+			local[i] = count.size();		// component id until bfs()
+			count.push_back(0);
 		}
+		count[local[root[i]]]++;
 	}
+	vector<int> offset(count.size() + 1, 0);
+	for(size_t c = 0; c < count.size(); ++c) offset[c + 1] = offset[c] + count[c];
+	comp_vert.resize(n);
+	vector<int> fill(offset.begin(), offset.end() - 1);
+	for(int i = 0; i < n; ++i) comp_vert[fill[local[root[i]]]++] = i;
+	for(size_t c = 0; c < count.size(); ++c)
+		rtn.push_back(component(this, offset[c], offset[c + 1]));
+
+	// BFS order inside every component
+	atomic<int> next(0);
+	parallel_for(threads, threads, [&](long, long){
+		vector<int> queue;
+		for(int c = next++; c < rtn.size(); c = next++) rtn[c].bfs(queue);
+	});
 	cout << "# of components: " << to_string(rtn.size()) << endl;
 	return rtn;
 }
@@ -150,141 +213,345 @@ int graph::size(){
 }
 
 
-double graph::get_dist(point a, point b){
+double graph::get_dist(const point &a, const point &b) const{
 	double sum = 0;
-	// assert a.pos.size() == b.pos.size()
-	for(auto i = 0; i < a.pos.size(); i++)
+	for(auto i = 0; i < 3; i++)
 		sum += (a.pos[i]-b.pos[i]) * (a.pos[i]-b.pos[i]);
 	return sqrt(sum);
 }
 
 
-int graph::find_vert(vector<int> pos){
-	if (pos.size() != 3){
-		cout << "position size mismatch\n";
-		return -1;
-	}
-	int rtn = 0;
-	double d = get_dist(v[0], point(pos));
+int component::global(int l) const{
+	return g->comp_vert[begin + l];
+}
 
-	for(auto idx = 1; idx < v.size(); idx++){
-		double newd = get_dist(v[rtn], v[idx]);
-		if (newd < d){
-			d = newd; rtn = idx;
+int component::local(int gl) const{
+	return g->local[gl];
+}
+
+
+// Renumbers the component in BFS order from its smallest vertex, the first
+// of its range. queue is scratch space.
+int component::bfs(vector<int> &queue){
+	vector<int> &cv = g->comp_vert, &loc = g->local;
+	const vector<int> &start = g->start, &adj = g->adj;
+	for(int k = begin; k < end; ++k) loc[cv[k]] = -1;
+	queue.clear();
+	queue.push_back(cv[begin]);
+	loc[cv[begin]] = 0;
+	for(int visit = 0; visit < queue.size(); ++visit){
+		int now = queue[visit];
+		for(int k = start[now]; k < start[now + 1]; ++k){
+			int vert = adj[k];
+			if (loc[vert] >= 0) continue;
+			loc[vert] = queue.size();
+			queue.push_back(vert);
 		}
 	}
-	return rtn;
+	copy(queue.begin(), queue.end(), cv.begin() + begin);
+	return 0;
 }
 
 
-vector<vector<int> > graph::dijkstra(const vector<int> &pos){
-	int root = find_vert(pos);
-	cout << "Root idx: " << root << endl;
-	
-	vector<double> dist(v.size(), std::numeric_limits<double>::infinity());
-	vector<vector<int> > tree_edge(v.size(), vector<int>());
+long long graph::sqdist(int idx, const int *pos) const{
+	const point &p = v[idx];
+	long long sum = 0;
+	for(int i = 0; i < 3; i++){
+		long long d = p.pos[i] - pos[i];
+		sum += d * d;
+	}
+	return sum;
+}
 
-	dist[root] = 0;
-	// using priority queue is not optimal algorithm, but 
-	// it is still near-linear and is much easier to develop.
-	// Optimal: Fibonacci heap.
-	priority_queue<vertex, std::vector<vertex>, vertex_cmp> pq;
-	pq.push(vertex(root, -1, 0));
 
-	while(!pq.empty()){
-		vertex dij_v = pq.top();
-		pq.pop();
-		double cur_d = dist[dij_v.idx];
+void graph::kd_build(int lo, int hi, int axis){
+	if (hi - lo <= 1) return;
+	int mid = (lo + hi) / 2;
+	nth_element(kd.begin() + lo, kd.begin() + mid, kd.begin() + hi, [&](int a, int b){
+		int pa = v[a].pos[axis], pb = v[b].pos[axis];
+		return pa < pb || (pa == pb && a < b);
+	});
+	kd_build(lo, mid, (axis + 1) % 3);
+	kd_build(mid + 1, hi, (axis + 1) % 3);
+}
 
-		if (dij_v.idx != root){
-			tree_edge[dij_v.prev].push_back(dij_v.idx);
-			tree_edge[dij_v.idx].push_back(dij_v.prev);
-		}
-		//cout << "At " << dij_v.idx << " found " << endl;
-
-		for(auto adj_v : e[dij_v.idx]){
-			double d = get_dist(v[dij_v.idx], v[adj_v]);
-			//cout << adj_v << " : " << d << "<>" << dist[adj_v] << endl;
-			if (cur_d + d < dist[adj_v]){
-				dist[adj_v] = cur_d + d;
-				pq.push(vertex(adj_v, dij_v.idx, cur_d + d));
+
+// Vertices outside component comp of owner are visited but never taken
+void graph::kd_search(int lo, int hi, int axis, const int *pos, const vector<int> *owner,
+					  int comp, int &best, long long &bestd) const{
+	if (lo >= hi) return;
+	int mid = (lo + hi) / 2, idx = kd[mid];
+	long long d = sqdist(idx, pos);
+	// ties go to the smaller vertex index
+	if ((owner == NULL || (*owner)[idx] == comp) &&
+		(d < bestd || (d == bestd && idx < best))){
+		bestd = d; best = idx;
+	}
+	long long diff = pos[axis] - v[idx].pos[axis];
+	int next = (axis + 1) % 3;
+	if (diff < 0){
+		kd_search(lo, mid, next, pos, owner, comp, best, bestd);
+		if (diff * diff <= bestd) kd_search(mid + 1, hi, next, pos, owner, comp, best, bestd);
+	}else{
+		kd_search(mid + 1, hi, next, pos, owner, comp, best, bestd);
+		if (diff * diff <= bestd) kd_search(lo, mid, next, pos, owner, comp, best, bestd);
+	}
+}
+
+
+// Nearest vertex to pos (x y z), restricted to component comp when owner
+// maps every vertex to its component; -1 if there is none
+int graph::find_vert(const int *pos, const vector<int> *owner, int comp) const{
+	int best = -1;
+	long long bestd = numeric_limits<long long>::max();
+	kd_search(0, kd.size(), 0, pos, owner, comp, best, bestd);
+	return best;
+}
+
+
+// Roots (local ids) of each of the ncomp components: every root in pos
+// (x y z per root) goes to the component of its nearest vertex, so one soma
+// seeds one component. A component of todo that gets no root is rooted at
+// its own vertex nearest to any of the roots.
+vector<vector<int> > graph::find_roots(const vector<int> &pos, const vector<int> &owner,
+									   int ncomp, const vector<int> &todo) const{
+	vector<vector<int> > rtn(ncomp);
+	if (pos.size() == 0 || pos.size() % 3 != 0){
+		cout << "position size mismatch\n";
+		return rtn;
+	}
+	for(size_t i = 0; i < pos.size(); i += 3){
+		int r = find_vert(&pos[i]);
+		if (r < 0) continue;
+		vector<int> &cr = rtn[owner[r]];
+		if (find(cr.begin(), cr.end(), local[r]) == cr.end()) cr.push_back(local[r]);
+	}
+	for(auto c : todo){
+		if (!rtn[c].empty()) continue;
+		int best = -1;
+		long long bestd = numeric_limits<long long>::max();
+		for(size_t i = 0; i < pos.size(); i += 3){
+			int r = find_vert(&pos[i], &owner, c);
+			if (r < 0) continue;
+			long long d = sqdist(r, &pos[i]);
+			if (d < bestd){
+				bestd = d; best = r;
 			}
 		}
+		if (best >= 0) rtn[c].push_back(local[best]);
+	}
+	return rtn;
+}
+
 
-		while(!pq.empty() && dist[pq.top().idx] < pq.top().f) pq.pop();
+// Shortest path forest grown from the root vertices (local ids)
+void component::dijkstra(const vector<int> &root){
+	int n = size();
+	const vector<int> &start = g->start, &adj = g->adj;
+	const vector<double> &len = g->len;
+	dist.assign(n, std::numeric_limits<double>::infinity());
+	parent.assign(n, -1);
+	order.clear();
+	order.reserve(n);
+
+	double minlen = numeric_limits<double>::infinity(), maxlen = 0;
+	for(int l = 0; l < n; ++l){
+		int gl = global(l);
+		for(int k = start[gl]; k < start[gl + 1]; ++k){
+			if (len[k] > 0) minlen = min(minlen, len[k]);
+			maxlen = max(maxlen, len[k]);
+		}
 	}
 
-	for(auto i = 0; i < v.size(); ++i)
-		v[i].f = dist[i];
+	// Bucket queue (Dial): bucket b holds distances in [b*width, (b+1)*width).
+	// width is the shortest edge, so settling a bucket never moves another
+	// entry of it. Buckets are emptied through a small heap ordered by
+	// (distance, index), which gives the settle order of a plain priority
+	// queue with a fixed tie rule. Ring of nbucket buckets, since pending
+	// distances span at most maxlen.
+	double width = minlen < numeric_limits<double>::infinity()? minlen : 1.0;
+	long nbucket = (long)(maxlen / width) + 2;
+	vector<vector<vertex> > bucket(nbucket);
+	long pending = 0;
+	auto push = [&](const vertex &x){
+		bucket[(long)(x.f / width) % nbucket].push_back(x);
+		pending++;
+	};
+	for(auto r : root){
+		dist[r] = 0;
+		push(vertex(r, -1, 0));
+	}
 
-	dist_created = 1;
-	return tree_edge;
+	priority_queue<vertex, std::vector<vertex>, vertex_cmp> pq;
+	for(long cur = 0; pending > 0; ++cur){
+		vector<vertex> &bk = bucket[cur % nbucket];
+		if (bk.empty()) continue;
+		for(auto &x : bk) pq.push(x);
+		pending -= bk.size();
+		bk.clear();
+
+		while(!pq.empty()){
+			vertex dij_v = pq.top();
+			pq.pop();
+			// stale entry, dist was lowered after it was queued
+			if (dist[dij_v.idx] < dij_v.f) continue;
+			double cur_d = dist[dij_v.idx];
+			parent[dij_v.idx] = dij_v.prev;
+			order.push_back(dij_v.idx);
+
+			int gl = global(dij_v.idx);
+			for(int k = start[gl]; k < start[gl + 1]; ++k){
+				int adj_v = local(adj[k]);
+				double d = cur_d + len[k];
+				if (d < dist[adj_v]){
+					dist[adj_v] = d;
+					// zero-length edges and rounding may land in the current bucket
+					if ((long)(d / width) <= cur) pq.push(vertex(adj_v, dij_v.idx, d));
+					else push(vertex(adj_v, dij_v.idx, d));
+				}
+			}
+		}
+	}
 }
 
 
-int graph::set_edge(const vector<vector<int> > &tree_edge){
-	e = tree_edge;
-	return 0;
+// Tree adjacency in CSR form, every row in settle order
+static void tree_rows(const vector<int> &order, const vector<int> &parent,
+					  vector<int> &tstart, vector<int> &tadj){
+	int n = parent.size();
+	tstart.assign(n + 1, 0);
+	for(auto x : order)
+		if (parent[x] >= 0){
+			tstart[x + 1]++;
+			tstart[parent[x] + 1]++;
+		}
+	for(int i = 0; i < n; ++i) tstart[i + 1] += tstart[i];
+	tadj.resize(tstart[n]);
+	vector<int> pos(tstart.begin(), tstart.end() - 1);
+	for(auto x : order)
+		if (parent[x] >= 0){
+			tadj[pos[parent[x]]++] = x;
+			tadj[pos[x]++] = parent[x];
+		}
 }
 
-int graph::to_swc(string filename){
-	return 0;
-}
 
-int graph::to_file(string filename){
+int component::to_file(string filename){
 	ofstream vertout;
 	vertout.open(filename+"_vert.txt");
-	for(auto vert : v){
-		vertout << vert << endl;
+	for(int l = 0; l < size(); ++l){
+		point p = g->v[global(l)];
+		p.f = dist[l];
+		vertout << p << endl;
 	}
 	vertout.close();
 
+	vector<int> tstart, tadj;
+	tree_rows(order, parent, tstart, tadj);
 	ofstream edgeout;
 	edgeout.open(filename+"_edge.txt");
-	for(int v0 = 0; v0 < (int)e.size(); v0++){
-		for(auto v : e[v0]){
-			if (v0 < v)
+	for(int v0 = 0; v0 < size(); v0++){
+		for(int k = tstart[v0]; k < tstart[v0 + 1]; ++k){
+			if (v0 < tadj[k])
 				// write only one pair of edge
-				edgeout << make_pair(v0+1, v+1) << endl;
+				edgeout << make_pair(v0+1, tadj[k]+1) << endl;
 		}
 	}
 	edgeout.close();
 	return 0;
 }
 
-int graph::to_simplcial(string filename){
+int component::to_simplcial(string filename){
 	ofstream ofs(filename,ios::binary);
 
-	char* intwriter = new char[sizeof(int)];
-	int* intbuffer = (int*) intwriter;
-
-	char* vert = new char[sizeof(double) * 4];
-	double* vert_buffer = (double*) vert;
-
-	intbuffer[0] = v.size();
-	ofs.write(intwriter, sizeof(int));
-	for (int i = 0; i < v.size(); i++){
-		vert_buffer[0] = v[i].pos[0]; vert_buffer[1] = v[i].pos[1];
-		vert_buffer[2] = v[i].pos[2]; vert_buffer[3] = v[i].f;
-		ofs.write(vert, sizeof(double) * 4);
+	int count = size();
+	ofs.write((char*) &count, sizeof(int));
+	for (int i = 0; i < size(); i++){
+		const point &p = g->v[global(i)];
+		double vert_buffer[4] = {(double)p.pos[0], (double)p.pos[1], (double)p.pos[2], dist[i]};
+		ofs.write((char*) vert_buffer, sizeof(double) * 4);
 	}
-	
-	char* edgechar = new char[sizeof(int) * 2];
-	int* edge_buffer = (int*) edgechar;
-	intbuffer[0] = v.size()-1;
-	ofs.write(intwriter, sizeof(int));
-	int counter = 0;
-	for (int i = 0; i < e.size(); i++){
-		for(int j = 0; j < e[i].size(); ++j){
+
+	vector<int> tstart, tadj;
+	tree_rows(order, parent, tstart, tadj);
+	// size()-1 for a tree, fewer for a forest
+	count = tadj.size() / 2;
+	ofs.write((char*) &count, sizeof(int));
+	for (int i = 0; i < size(); i++){
+		for(int k = tstart[i]; k < tstart[i + 1]; ++k){
 			// write only one edge for bidirenctional edges
-			if (i >= e[i][j]) continue;
-			edge_buffer[0] = i; edge_buffer[1] = e[i][j];
-			ofs.write(edgechar, sizeof(int) * 2);
-			counter ++;
+			if (i >= tadj[k]) continue;
+			int edge_buffer[2] = {i, tadj[k]};
+			ofs.write((char*) edge_buffer, sizeof(int) * 2);
 		}
 	}
-	
-	intbuffer[0] = 0;
-	ofs.write(intwriter, sizeof(int));
+
+	count = 0;
+	ofs.write((char*) &count, sizeof(int));
 	ofs.close();
-}
\ No newline at end of file
+	return 0;
+}
+
+// Shortest path tree of each component with at least comp vertices,
+// or of the largest component(s) if comp < 0.
+// root holds one or more x y z; each root is snapped to its nearest vertex
+// in the whole graph and seeds that vertex's component, so a component with
+// several roots becomes a forest (see find_roots).
+// Components are numbered in order of their smallest vertex and processed
+// largest first on threads workers; each is written when it is done.
+int graph::extract_trees(const vector<int> &root, int comp, const string &outputprefix,
+						 int threads){
+	cout << "checking vertex and edge redundancy\n";
+	check_redundancy();
+	cout << "Counting Components: ";
+	vector<component> subgraph = split(threads);
+
+	int max_component = 0;
+	for (auto &subg : subgraph)
+		if (subg.size() > max_component) max_component = subg.size();
+	if (comp >= 0)
+		cout << "Component threshold: " << comp << endl;
+	else
+		cout << "Output maximum component(s), size: " << max_component <<endl;
+
+	vector<int> todo;
+	for (int c = 0; c < subgraph.size(); ++c)
+		if (comp >= 0? subgraph[c].size() >= comp : subgraph[c].size() == max_component)
+			todo.push_back(c);
+	vector<int> number(subgraph.size(), -1);
+	for (int t = 0; t < todo.size(); ++t) number[todo[t]] = t;
+	stable_sort(todo.begin(), todo.end(), [&](int a, int b){
+		return subgraph[a].size() > subgraph[b].size();
+	});
+
+	// one kd-tree for all root lookups
+	vector<int> owner(v.size());
+	for (int c = 0; c < subgraph.size(); ++c)
+		for (int l = 0; l < subgraph[c].size(); ++l) owner[subgraph[c].global(l)] = c;
+	kd.resize(v.size());
+	for(int i = 0; i < kd.size(); ++i) kd[i] = i;
+	kd_build(0, kd.size(), 0);
+	vector<vector<int> > roots = find_roots(root, owner, subgraph.size(), todo);
+
+	mutex log;
+	atomic<int> next(0);
+	parallel_for(threads, threads, [&](long, long){
+		for(int t = next++; t < todo.size(); t = next++){
+			component &subg = subgraph[todo[t]];
+			int counter = number[todo[t]];
+			const vector<int> &r = roots[todo[t]];
+			subg.dijkstra(r);
+			subg.to_file(outputprefix + "_tree_" + to_string(counter));
+			subg.to_simplcial(outputprefix + "_simplicial_" + to_string(counter));
+			{
+				lock_guard<mutex> lock(log);
+				cout << "Tree " << counter << ": " << subg.size() << " vertices, root idx:";
+				for(auto x : r) cout << " " << x;
+				cout << endl;
+			}
+			subg = component(this, 0, 0);
+		}
+	});
+	cout << "Components written: " << todo.size() << endl;
+	return todo.size();
+}
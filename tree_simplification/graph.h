@@ -8,29 +8,23 @@
 #include<cmath>
 #include<limits>
 #include<queue>
+#include<atomic>
+#include<mutex>
 using namespace std;
 
 struct point{
 	// We are processing pixels so the position is always integer
-	vector<int> pos;
+	int pos[3];
 	double f;
 
-	point(int x, int y, int z, int func){
-		pos.push_back(x);pos.push_back(y);pos.push_back(z);
+	point(int x, int y, int z, double func){
+		pos[0] = x; pos[1] = y; pos[2] = z;
 		f = func;
 	}
-	point(const point &p){
-		pos = p.pos;
-		f = p.f;
-	}
-	point(const vector<int> &p){
-		pos = p;
-		f = 0;
-	}
 	point(){return;}
 
 	// Maybe there is better solution
-	friend ostream& operator<<(ostream& os, const point & p)  
+	friend ostream& operator<<(ostream& os, const point & p)
 	{
 		for(auto x : p.pos)
 			os << x << ' ';
@@ -57,8 +51,8 @@ class vertex_cmp
 public:
     bool operator() (const vertex &a, const vertex &b)
     {
-    	// Min Heap
-        return a.f > b.f;
+    	// Min Heap, ties by vertex index
+        return a.f > b.f || (a.f == b.f && a.idx > b.idx);
     }
 };
 
@@ -82,41 +76,78 @@ ostream& operator<<(ostream& os, const pair<int, int>& edge)
 */
 
 
+class graph;
+
+// A connected component of a graph. Only the range of its vertices in
+// graph::comp_vert is stored; local ids are positions in that range.
+class component{
+private:
+	graph *g;
+	int begin, end;
+
+	// shortest path forest from dijkstra
+	vector<double> dist;
+	vector<int> order, parent;		// settle order, parent per local id (-1 for roots)
+
+public:
+	component(graph *parent_graph, int b, int e){g = parent_graph; begin = b; end = e;}
+
+	int size(){return end - begin;}
+	int global(int local) const;
+	int local(int global) const;
+
+	int bfs(vector<int> &queue);
+	void dijkstra(const vector<int> &root);
+
+	int to_file(string filename);
+	int to_simplcial(string filename);
+};
+
+
 class graph{
+friend class component;
 private:
 	vector<point> v;
-	vector<vector<int> > e;
-	int dist_created=0;
-	
+	// CSR adjacency: neighbours of i are adj[start[i]] .. adj[start[i+1]-1],
+	// len holds the matching edge lengths
+	vector<int> start, adj;
+	vector<double> len;
+	vector<int> edge_in;			// 0-based pairs until build()
+
+	// components as ranges of comp_vert (BFS order); local[i] is the
+	// position of vertex i inside its component
+	vector<int> comp_vert, local;
+
+	// kd-tree over vertex ids: every range [lo, hi) of kd is split at its
+	// middle element along axis depth % 3. Built by extract_trees.
+	vector<int> kd;
+	void kd_build(int lo, int hi, int axis);
+	void kd_search(int lo, int hi, int axis, const int *pos, const vector<int> *owner,
+				   int comp, int &best, long long &bestd) const;
+	long long sqdist(int idx, const int *pos) const;
+
+	int build();
+
 public:
 	graph();
-	graph(string filename);
 	graph(string vert, string edge);
-	
-	int fromfile(const string & filename);
+	graph(const vector<double> &vert, const vector<int> &edge);
+
 	int loadvert(const string & filename);
 	int loadedge(const string & filename);
 
 	int size();
-	
-	int threshold_saddle(double thd);
-	
-	int shiftvert(vector<double> pos);
-	int find_vert(vector<int> pos);
-	double get_dist(point a, point b);
-	
+
+	double get_dist(const point &a, const point &b) const;
+
 	int check_redundancy();
-	
-	graph traverse(const int start, const vector<point> & v, 
-					const vector<vector<int> > & e, vector<bool> & touched);
-	vector<pair<int, int> > components();
-	
-	vector<vector<int> > dijkstra(const vector<int> &pos);
-	
-	vector<graph> split();
-
-	int set_edge(const vector<vector<int> > & tree_edge);
-	int to_swc(string filename);
-	int to_file(string filename);
-	int to_simplcial(string filename);
-};
\ No newline at end of file
+
+	vector<component> split(int threads = 1);
+
+	int find_vert(const int *pos, const vector<int> *owner = NULL, int comp = -1) const;
+	vector<vector<int> > find_roots(const vector<int> &pos, const vector<int> &owner,
+									int ncomp, const vector<int> &todo) const;
+
+	int extract_trees(const vector<int> &root, int comp, const string &outputprefix,
+					  int threads = 1);
+};
@@ -1,7 +1,9 @@
 #include<iostream>
 #include<fstream>
+#include<thread>
 #include"graph.h"
 #include"readini.h"
+#include"metrics.h"
 
 using namespace std;
 #define DEBUG 1
@@ -13,17 +15,20 @@ using namespace std;
 
 	
 	saddle_threshold: Removes saddles whose density is lower than threshold
-	pos: Root location
+	pos: Root location(s), x y z each. A root seeds the component of its
+	     nearest vertex; several roots in one component grow a forest.
+	     A component without a root starts from its vertex nearest to one.
 */
 
 /*
-	usage: ./graph2tree <graph_file.ini>
+	usage: ./graph2tree <graph_file.ini> [threads]
 	graph_file.ini: if does not exist, create one
+	threads: components are processed in parallel, default 1, 0 for all cores
 	format:
 		<input vertex filename>
 		<input edge filename>
 		<output folder+prefix>
-		<root>
+		<root> [<root> ...]
 		<threshold>
 		[Component #]
 		[shift]
@@ -43,6 +48,7 @@ using namespace std;
 		[not specified: use default]
 	
 	outputs to 0.swc or 0_0.swc ~ 0_x.swc if n connected components are available
+	stage times and sizes go to <output prefix>_metrics.json
 */
 
 int main(int argc, char* argv[]){
@@ -50,13 +56,16 @@ int main(int argc, char* argv[]){
 	string ininame;
 	
 	//  Resolving parameters
-    if (argc != 2){
-		cout << "Usage: ./graph2tree graphfile.ini"	<<endl;
+	int threads = 1;
+    if (argc != 2 && argc != 3){
+		cout << "Usage: ./graph2tree graphfile.ini [threads]"	<<endl;
 		cout << "default output/0.ini is generated" << endl;
 		default_ini();
 		return 0;
     }else{
 		ininame = string(argv[1]);
+		if (argc == 3) threads = atoi(argv[2]);
+		if (threads <= 0) threads = thread::hardware_concurrency();
 		
 		int stat = loadini(ininame, para);
 		if (stat == -1){
@@ -67,41 +76,15 @@ int main(int argc, char* argv[]){
     
 	//	Processing Graph
 	//  graph G(para.ininame);
+	Metrics M("graph2tree");
 	cout << "Loading Graph from " + para.vertfile + " " + para.edgefile << endl;
+	Stage load(M, "load");
 	graph G(para.vertfile, para.edgefile);
-	cout << "checking vertex and edge redundancy\n";
-	G.check_redundancy();
-	cout << "Counting Components: ";
-	vector<graph> subgraph = G.split();
-	//cout << subgraph.size() << endl;
+	load.stop();
+	M.count("vertices", G.size());
+	Stage trees(M, "extract_trees");
+	M.count("trees", G.extract_trees(para.root, para.comp, para.outputprefix, threads));
+	trees.stop();
+	M.write(para.outputprefix + "_metrics.json");
 
-	int counter = 0;
-	if (para.comp >=0){
-		cout << "Component threshold: " << para.comp << endl;
-		for (auto subg : subgraph){
-			if (subg.size() < para.comp) continue;
-			vector<vector<int> > edge = subg.dijkstra(para.root);
-			subg.set_edge(edge);
-			//subg.to_swc(para.outputprefix + to_string(counter) + ".swc");
-			subg.to_file(para.outputprefix + "_tree_" + to_string(counter));
-			subg.to_simplcial(para.outputprefix + "_simplicial_" + to_string(counter++));
-		}
-	}
-	else{
-		int max_component = 0;
-		for (auto subg : subgraph)
-			if (subg.size() > max_component) max_component = subg.size();
-
-		cout << "Output maximum component(s), size: " << max_component <<endl;
-		for (auto subg:subgraph)
-			if (subg.size() == max_component){
-				vector<vector<int> > edge = subg.dijkstra(para.root);
-				subg.set_edge(edge);
-				//subg.to_swc(para.outputprefix + to_string(counter) + ".swc");
-				subg.to_file(para.outputprefix + "_tree_" + to_string(counter));
-				subg.to_simplcial(para.outputprefix + "_simplicial_" + to_string(counter++));
-			}
-	}
-	cout << "Components written: " << counter << endl;
-	
 }